@@ -30,13 +30,15 @@
 
 #include "B4DetectorConstruction.hh"
 #include "B4aActionInitialization.hh"
+#include "B4RunAction.hh"
+#include "B4Launcher.hh"
 
 #ifdef G4MULTITHREADED
-#undef G4MULTITHREADED
-#endif
-
-#ifdef G4MULTITHREADED
+#include "G4Version.hh"
 #include "G4MTRunManager.hh"
+#if G4VERSION_NUMBER >= 1100
+#include "G4TaskRunManager.hh"
+#endif
 #else
 #include "G4RunManager.hh"
 #endif
@@ -53,14 +55,30 @@
 #include "G4UIExecutive.hh"
 #include "G4RandomTools.hh"
 
+#include <chrono>
+#include <cstdlib>
+
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
 namespace {
   void PrintUsage() {
     G4cerr << " Usage: " << G4endl;
-    G4cerr << " exampleB4a [-m macro ] [-u UIsession] [-t nThreads]" << G4endl;
-    G4cerr << "   note: -t option is available only for multi-threaded mode."
-           << G4endl;
+    G4cerr << " exampleB4a [-m macro ] [-u UIsession] [-t nThreads] [-f outfile]"
+           << " [-r sd|step] [-p mt|tasks] [-j nProcesses] [-c auto|cpulist]"
+           << " [-s seed] [-e [run:]event]" << G4endl;
+    G4cerr << "   note: -t and -p options are available only for multi-threaded mode,"
+           << " the default is one worker thread." << G4endl;
+    G4cerr << "   -p tasks: events are handed out one by one (task run manager"
+           << " from Geant4 11), each worker writes its own file and the master"
+           << " a manifest of the files" << G4endl;
+    G4cerr << "   -r: readout with sensitive detectors (default) or with the"
+           << " stepping action" << G4endl;
+    G4cerr << "   -j: fork processes running the macro (-m), process i simulates"
+           << " events i*N to (i+1)*N-1 of the job seed and writes"
+           << " <outfile>_j<i>, -c pins them to CPUs" << G4endl;
+    G4cerr << "   -s: job seed, every event is seeded from it, the run and the"
+           << " event number" << G4endl;
+    G4cerr << "   -e: re-simulate only this event of the macro, verbosely" << G4endl;
   }
 }
 
@@ -70,7 +88,7 @@ int main(int argc,char** argv)
 {
   // Evaluate arguments
   //
-  if ( argc > 7 ) {
+  if ( argc > 21 ) {
     PrintUsage();
     return 1;
   }
@@ -78,8 +96,14 @@ int main(int argc,char** argv)
   G4String macro;
   G4String session;
   G4String outfile="out";
+  G4String readout="sd";
+  G4int nJobs = 0;
+  G4String cpus;
+  long rseed = 0;
+  G4String replay;
 #ifdef G4MULTITHREADED
-  G4int nThreads = 0;
+  G4int nThreads = 1;
+  G4String scheduling = "mt";
 #endif
   for ( G4int i=1; i<argc; i=i+2 ) {
     if      ( G4String(argv[i]) == "-m" ) macro = argv[i+1];
@@ -88,16 +112,48 @@ int main(int argc,char** argv)
     else if ( G4String(argv[i]) == "-t" ) {
       nThreads = G4UIcommand::ConvertToInt(argv[i+1]);
     }
+    else if ( G4String(argv[i]) == "-p" ) {
+      scheduling = argv[i+1];
+    }
 #endif
     else if (G4String(argv[i]) == "-f" ) {
     	outfile = argv[i+1];
     }
+    else if (G4String(argv[i]) == "-r" ) {
+    	readout = argv[i+1];
+    }
+    else if ( G4String(argv[i]) == "-j" ) {
+      nJobs = G4UIcommand::ConvertToInt(argv[i+1]);
+    }
+    else if ( G4String(argv[i]) == "-c" ) {
+      cpus = argv[i+1];
+    }
+    else if ( G4String(argv[i]) == "-s" ) {
+      rseed = std::atol(argv[i+1]);
+    }
+    else if ( G4String(argv[i]) == "-e" ) {
+      replay = argv[i+1];
+    }
     else {
       PrintUsage();
       return 1;
     }
   }  
-  long rseed=0;
+
+  // Fork the shards before anything of Geant4 is set up, the launcher
+  // itself only waits and writes the summary
+  //
+  // the shards write their output to log files, they cannot be interactive
+  if ( nJobs > 0 && macro.empty() ) {
+    G4cerr << " -j needs a macro (-m)" << G4endl;
+    PrintUsage();
+    return 1;
+  }
+  B4Launcher launcher(nJobs, cpus, outfile, rseed);
+  if ( nJobs > 0 ) {
+    if ( !launcher.launch() ) return launcher.exitCode();
+    outfile = launcher.getOutputFile();
+  }
   // Detect interactive mode (if no macro provided) and define UI session
   //
 
@@ -109,10 +165,25 @@ int main(int argc,char** argv)
   // Construct the default run manager
   //
 #ifdef G4MULTITHREADED
+  if ( scheduling != "mt" && scheduling != "tasks" ) {
+    PrintUsage();
+    return 1;
+  }
+  G4bool tasks = scheduling == "tasks";
+#if G4VERSION_NUMBER >= 1100
+  G4MTRunManager* runManager = nullptr;
+  if ( tasks ) runManager = new G4TaskRunManager;
+  else         runManager = new G4MTRunManager;
+#else
+  // no task run manager before Geant4 11: hand out single events, a worker
+  // that finishes early takes the next one instead of idling
   auto runManager = new G4MTRunManager;
+  if ( tasks ) runManager->SetEventModulo(1);
+#endif
   if ( nThreads > 0 ) { 
     runManager->SetNumberOfThreads(nThreads);
-  }  
+  }
+  // events are reseeded by the generator, see B4PrimaryGeneratorAction
 #else
   auto runManager = new G4RunManager;
 #endif
@@ -120,13 +191,26 @@ int main(int argc,char** argv)
   // Set mandatory initialization classes
   //
   auto detConstruction = new B4DetectorConstruction();
+  if ( readout == "step" ) {
+    detConstruction->setReadoutMode(B4DetectorConstruction::readout_stepping);
+  }
+  else if ( readout != "sd" ) {
+    PrintUsage();
+    return 1;
+  }
   runManager->SetUserInitialization(detConstruction);
 
   auto physicsList = new FTFP_BERT;
+  // the fast simulation process is added by /B4/fastsim/enable true or
+  // /B4/showerlib/mode use
+  detConstruction->setPhysicsList(physicsList);
   runManager->SetUserInitialization(physicsList);
     
   auto actionInitialization = new B4aActionInitialization(detConstruction);
   actionInitialization->setFilename(outfile);
+#ifdef G4MULTITHREADED
+  actionInitialization->setShardedOutput(tasks);
+#endif
   runManager->SetUserInitialization(actionInitialization);
   
   // Initialize visualization
@@ -144,8 +228,20 @@ int main(int argc,char** argv)
   if ( macro.size() ) {
     // batch mode
     G4String command = "/control/execute ";
-    G4Random::setTheSeeds(&rseed);
+    // the engine state carries nothing from one event to the next, the
+    // generator reseeds it per event, see B4PrimaryGeneratorAction
+    UImanager->ApplyCommand("/B4/gun/seed " + std::to_string(rseed));
+    if ( nJobs > 0 ) {
+      UImanager->ApplyCommand("/B4/gun/shard " + std::to_string(launcher.getShard()));
+    }
+    if ( replay.size() ) {
+      UImanager->ApplyCommand("/B4/gun/replay " + replay);
+    }
+    auto start = std::chrono::steady_clock::now();
     UImanager->ApplyCommand(command+macro);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    auto runAction = static_cast<const B4RunAction*>(runManager->GetUserRunAction());
+    launcher.report(runAction ? runAction->getEventsInJob() : 0, elapsed.count());
   }
   else  {  
     // interactive mode : define UI session
@@ -0,0 +1,98 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+//
+/// \file B4CalorHit.hh
+/// \brief Definition of the B4CalorHit class
+
+#ifndef B4CalorHit_h
+#define B4CalorHit_h 1
+
+#include "G4VHit.hh"
+#include "G4THitsCollection.hh"
+#include "G4Allocator.hh"
+#include "globals.hh"
+
+/// Calorimeter hit class
+///
+/// One hit per fired sensor and event. It holds the index of the sensor
+/// in B4DetectorConstruction::getActiveSensors() and the energy deposited
+/// in its gap and in its absorber.
+
+class B4CalorHit : public G4VHit
+{
+  public:
+    B4CalorHit(G4int sensorindex=-1);
+    virtual ~B4CalorHit();
+
+    inline void* operator new(size_t);
+    inline void  operator delete(void*);
+
+    void Add(G4double de, G4bool isabsorber);
+
+    G4int GetSensorIndex() const { return fSensorIndex; }
+    G4double GetEdep() const { return fEdep; }
+    G4double GetAbsorberEdep() const { return fAbsorberEdep; }
+
+  private:
+    G4int    fSensorIndex;
+    G4double fEdep;
+    G4double fAbsorberEdep;
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+typedef G4THitsCollection<B4CalorHit> B4CalorHitsCollection;
+
+extern G4ThreadLocal G4Allocator<B4CalorHit>* B4CalorHitAllocator;
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+inline void* B4CalorHit::operator new(size_t)
+{
+  if(!B4CalorHitAllocator)
+    B4CalorHitAllocator = new G4Allocator<B4CalorHit>;
+  void *hit;
+  hit = (void *) B4CalorHitAllocator->MallocSingle();
+  return hit;
+}
+
+inline void B4CalorHit::operator delete(void *hit)
+{
+  if(!B4CalorHitAllocator)
+    B4CalorHitAllocator = new G4Allocator<B4CalorHit>;
+  B4CalorHitAllocator->FreeSingle((B4CalorHit*) hit);
+}
+
+inline void B4CalorHit::Add(G4double de, G4bool isabsorber) {
+  if(isabsorber)
+    fAbsorberEdep += de;
+  else
+    fEdep += de;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
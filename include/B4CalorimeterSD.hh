@@ -0,0 +1,73 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+//
+/// \file B4CalorimeterSD.hh
+/// \brief Definition of the B4CalorimeterSD class
+
+#ifndef B4CalorimeterSD_h
+#define B4CalorimeterSD_h 1
+
+#include "G4VSensitiveDetector.hh"
+
+#include "B4CalorHit.hh"
+
+#include <vector>
+
+class G4Step;
+class G4HCofThisEvent;
+class B4DetectorConstruction;
+class primaryTruthAccumulator;
+class showerLibraryBuilder;
+
+/// Calorimeter sensitive detector class
+///
+/// Attached to the gap (and optionally the absorber) logical volumes only,
+/// so steps in passive volumes never reach user code.
+/// In ProcessHits() the energy deposit is added to the hit of the sensor
+/// the step belongs to. Hits are created on the first deposit in a sensor,
+/// so the hits collection only holds fired sensors.
+
+class B4CalorimeterSD : public G4VSensitiveDetector
+{
+  public:
+    B4CalorimeterSD(const G4String& name,
+                    const G4String& hitsCollectionName,
+                    const B4DetectorConstruction* detector);
+    virtual ~B4CalorimeterSD();
+
+    virtual void   Initialize(G4HCofThisEvent* hitCollection);
+    virtual G4bool ProcessHits(G4Step* step, G4TouchableHistory* history);
+
+  private:
+    B4CalorHitsCollection* fHitsCollection;
+    const B4DetectorConstruction* fDetConstruction;
+    std::vector<G4int> fHitIndex; //sensor index -> hit, -1 if not fired
+    std::vector<size_t> fFired;
+    primaryTruthAccumulator* fTruth;
+    showerLibraryBuilder* fLibrary;
+};
+
+#endif
@@ -0,0 +1,84 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+//
+/// \file B4Clusterer.hh
+/// \brief Definition of the B4Clusterer class
+
+#ifndef B4Clusterer_h
+#define B4Clusterer_h 1
+
+#include "globals.hh"
+
+#include <vector>
+
+class G4GenericMessenger;
+class B4DetectorConstruction;
+
+/// Topological clustering of the per-sensor energies.
+///
+/// Sensors above the seed threshold start a cluster, in decreasing energy.
+/// A cluster grows over the neighbour graph of B4DetectorConstruction to
+/// all sensors above the cell threshold (the output threshold), but only
+/// sensors above the growth threshold pass it on to their own neighbours.
+/// Each sensor belongs to the first cluster that reaches it.
+///
+/// Per cluster the energy, the energy weighted position and the energy
+/// weighted transverse width are written, see /B4/cluster/.
+
+class B4Clusterer
+{
+	friend class B4RunAction;
+  public:
+    B4Clusterer();
+    ~B4Clusterer();
+
+    G4bool isEnabled()const{return enabled_;}
+
+    void process(const std::vector<G4double>& energies, G4double cellthreshold,
+    		const B4DetectorConstruction& detector);
+
+  private:
+    G4bool   enabled_;
+    G4double seedthreshold_;
+    G4double growththreshold_;
+
+    //per-event output
+    std::vector<G4double> energy_;
+    std::vector<G4double> x_;
+    std::vector<G4double> y_;
+    std::vector<G4double> z_;
+    std::vector<G4double> width_;
+    std::vector<G4int>    ncells_;
+
+    //work buffers
+    std::vector<G4int>  label_;
+    std::vector<size_t> seeds_;
+    std::vector<size_t> stack_;
+
+    G4GenericMessenger* fMessenger;
+};
+
+#endif
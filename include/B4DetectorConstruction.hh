@@ -37,10 +37,23 @@
 #include "G4ThreeVector.hh"
 
 #include "sensorContainer.h"
+#include "constructionProfiler.h"
+#include "B4EMShowerModel.hh"
+#include "B4ShowerLibraryModel.hh"
+#include "showerLibrary.h"
+
+#include "G4VTouchable.hh"
+#include "G4VPhysicalVolume.hh"
+
+#include <unordered_map>
+#include <map>
+#include <tuple>
 
 class G4VPhysicalVolume;
 class G4GlobalMagFieldMessenger;
+class G4GenericMessenger;
 class G4Material;
+class G4VModularPhysicsList;
 
 /// Detector construction class to define materials and geometry.
 /// The calorimeter is a box made of a given number of layers. A layer consists
@@ -72,15 +85,80 @@ class B4DetectorConstruction : public G4VUserDetectorConstruction
 		hcal_only_irregular,
 		ecal_only_irregular
     };
+    enum readoutMode{
+    	readout_sd,      //sensitive detectors on gap (and absorber) volumes
+		readout_stepping //global stepping action, for comparison
+    };
     virtual G4VPhysicalVolume* Construct();
     virtual void ConstructSDandField();
 
     void  DefineGeometry(geometry g);
 
+    /*
+     * run time geometry selection, /B4/det/ commands before /run/initialize.
+     * Granularity lists are whitespace separated, one entry per layer, and
+     * override the layer count of the selected geometry.
+     */
+    void setGeometry(G4String name);
+    void setLayerGranularity(G4String list);
+    void setSplitGranularity(G4String list);
+
+    void setReadoutMode(readoutMode m){readoutmode_=m;}
+    readoutMode getReadoutMode()const{return readoutmode_;}
+
     bool isActiveVolume(G4VPhysicalVolume*)const;
 
+    //tracks leaving the envelope are killed and counted as leakage
+    G4bool isKillingEscapes()const{return killescaping_;}
+
+    /*
+     * constant time lookup of the index in getActiveSensors() that belongs
+     * to a gap or absorber volume. Returns false for all other volumes.
+     * Gap and absorber volumes are shared between identical sensors, the
+     * index is the copy number of the sandwich placement one level up.
+     * For replicated regions (/B4/det/useReplicas) the index is taken from
+     * the cell and column replica numbers and the region copy number.
+     */
+    bool getSensorIndex(const G4VTouchable* touchable,
+    		size_t& idx, bool& isabsorber)const;
+
     const std::vector<sensorContainer>* getActiveSensors()const;
 
+    /*
+     * sensor index at a global position, from the z range of each layer and
+     * its LG/HG grids. False outside the sensors. Deposits energy from
+     * parameterisations without navigating.
+     */
+    bool getSensorIndexAt(const G4ThreeVector& pos, size_t& idx)const;
+
+    const G4Material* getActiveMaterial()const{return gapMaterial;}
+
+    /*
+     * the fast simulation process is only registered to this physics list
+     * when /B4/fastsim/enable true or /B4/showerlib/mode use is set (before
+     * /run/initialize), full simulation runs without it
+     */
+    void setPhysicsList(G4VModularPhysicsList* list){physicslist_=list;}
+
+    const B4ShowerLibraryParameters& getShowerLibraryParameters()const{
+    	return showerlibparameters_;
+    }
+    //recording binning of /B4/showerlib/, depth over the layer stack
+    void getShowerLibraryBinning(showerLibrary::header& binning)const;
+
+    /*
+     * neighbours of sensor idx as indices in getActiveSensors(): the
+     * touching sensors in the same layer and the overlapping ones in the
+     * adjacent layers. Built once at construction, stored as CSR.
+     */
+    const size_t* getNeighbours(size_t idx, size_t& nneighbours)const{
+    	nneighbours=neighbouroffsets_[idx+1]-neighbouroffsets_[idx];
+    	return neighbours_.data()+neighbouroffsets_[idx];
+    }
+
+    //times the sensor lookup (/B4/det/benchmarkLookup)
+    void benchmarkLookup(G4int nlookups);
+
      
   private:
     // methods
@@ -96,7 +174,25 @@ class B4DetectorConstruction : public G4VUserDetectorConstruction
 			G4double dz,
 			G4ThreeVector position,
 			G4String name, G4double absorberfraction,
-			G4VPhysicalVolume*& absorber);
+			G4VPhysicalVolume*& absorber, G4int copyno);
+
+    //returns the cached sandwich logical volume of this shape, builds it once
+    G4LogicalVolume* getSandwichLV(G4double dx, G4double dy, G4double dz,
+    		G4double absorberfraction,
+			G4VPhysicalVolume*& active, G4VPhysicalVolume*& absorber);
+
+    void buildSensorLookup();
+    void buildNeighbourGraph();
+    void buildSensorLocator();
+    void setFastSimParticles(G4String list);
+    void setFastSimEnabled(G4bool enable);
+    void registerFastSimPhysics();
+    void setShowerLibraryMode(G4String mode);
+
+    //places a block of nx x ny identical sandwiches as replicas, returns the region id
+    G4int createReplicaRegion(G4LogicalVolume* layerLV, G4ThreeVector lowercorner,
+    		G4int nx, G4int ny, G4double sensorsize, G4double thickness,
+			G4double absorberfraction);
 
     G4VPhysicalVolume* createLayer(G4LogicalVolume * caloLV,
     		G4double thickness,G4int granularity,
@@ -104,6 +200,32 @@ class B4DetectorConstruction : public G4VUserDetectorConstruction
     		G4String name, int number, G4double calibration, G4int    nsmallsensorsrow=-1);
   
     void createCalo(G4LogicalVolume * caloLV,G4ThreeVector position,G4String name);
+
+    //front and back z of the layer stack, in the same stacking as createCalo
+    void calorimeterExtent(G4double& front, G4double& back)const;
+
+    G4LogicalVolume* placeLayerVolume(G4LogicalVolume * caloLV, G4double thickness,
+    		G4ThreeVector position, G4String name, G4VPhysicalVolume*& layerPV);
+
+    //applies the messenger overrides on top of DefineGeometry
+    void applyGeometryOverrides();
+
+    /*
+     * binary cache of the sensor table (/B4/det/sensorCache <directory>),
+     * keyed by a hash of the geometry configuration. On a hit the sandwiches
+     * are placed directly from the table.
+     */
+    struct cachedSensor{
+    	G4double dimxy, dimz, area, posx, posy, posz;
+    	G4double energyscale, absfraction;
+    	G4int layer, grid, ix, iy;
+    };
+    unsigned long long configHash()const;
+    G4String sensorCacheFile()const;
+    bool readSensorCache(std::vector<cachedSensor>& sensors)const;
+    void writeSensorCache(const std::vector<G4double>& absfractions)const;
+    void createCaloFromCache(G4LogicalVolume * caloLV,G4ThreeVector position,G4String name,
+    		const std::vector<cachedSensor>& sensors);
     // data members
     //
     static G4ThreadLocal G4GlobalMagFieldMessenger*  fMagFieldMessenger; 
@@ -111,9 +233,70 @@ class B4DetectorConstruction : public G4VUserDetectorConstruction
 
     std::vector<sensorContainer> activecells_;
 
+    //gap and absorber volumes, value is true for absorbers
+    std::unordered_map<const G4VPhysicalVolume*,bool> sensorlookup_;
+
+    std::vector<size_t> neighbouroffsets_, neighbours_;
+
+    struct layerGrid{
+    	G4double zmin, zmax;
+    	G4double lgsize, hgsize; //0 if the layer has no such grid
+    	G4int layer;
+    };
+    std::vector<layerGrid> layergrids_; //in z order
+    std::unordered_map<G4int,size_t> detidindex_;
+
+    B4EMShowerParameters fastsimparameters_;
+    G4GenericMessenger* fFastSimMessenger;
+    G4VModularPhysicsList* physicslist_;
+    G4bool fastsimphysics_; //registered to physicslist_
+
+    B4ShowerLibraryParameters showerlibparameters_;
+    showerLibrary showerlibrary_; //mapped at construction, shared by all threads
+    G4GenericMessenger* fShowerLibMessenger;
+
+    struct sandwichEntry{
+    	G4LogicalVolume* sandwich;
+    	G4VPhysicalVolume* active;
+    	G4VPhysicalVolume* absorber;
+    };
+    typedef std::tuple<G4double,G4double,G4double,G4double,
+    		const G4Material*,const G4Material*,const G4Material*> sandwichKey;
+    std::map<sandwichKey,sandwichEntry> sandwichcache_;
+    G4VPhysicalVolume* worldPV_;
+    G4LogicalVolume* envelopeLV_;
+    G4ThreeVector caloorigin_; //world position of the envelope frame
+    G4double envelopemargin_;
+    G4bool killescaping_;
+
+    //replicated regions: sensor index of cell (ix,iy) is replicatable_[offset+ix*ny+iy]
+    struct replicaRegion{
+    	size_t offset;
+    	G4int ny;
+    };
+    std::vector<replicaRegion> replicaregions_;
+    std::vector<size_t> replicatable_;
+    G4bool usereplicas_;
+
+    G4GenericMessenger* fMessenger;
+    volatile size_t benchmarksink_;
+
+    constructionProfiler profiler_;
+    G4int verbose_;            //1: layers and materials, 2: every sensor
+    G4bool profilevoxels_;     //time an extra voxelization pass
+
     G4bool  fCheckOverlaps; // option to activate checking of volumes overlaps
 
+    readoutMode readoutmode_;
+    G4bool readoutabsorber_; // also attach the sensitive detector to absorbers
+
+    geometry geometry_;
+    std::vector<G4int> granularityoverride_, splitoverride_;
+    G4double thicknessEEoverride_, thicknessHBoverride_; //<=0: geometry default
+    G4String sensorcache_;
+
     G4double layerThicknessEE,layerThicknessHB;
+    G4double absorberFractionEE,absorberFractionHB;
     std::vector<G4int> layerGranularity;
     std::vector<G4int> layerSplitGranularity;
     G4double calorSizeXY;
@@ -131,6 +314,22 @@ inline const std::vector<sensorContainer>* B4DetectorConstruction::getActiveSens
 	return &activecells_;
 }
 
+inline bool B4DetectorConstruction::getSensorIndex(const G4VTouchable* touchable,
+		size_t& idx, bool& isabsorber)const{
+	auto it=sensorlookup_.find(touchable->GetVolume());
+	if(it==sensorlookup_.end())
+		return false;
+	if(touchable->GetVolume(1)->IsReplicated()){
+		const replicaRegion& r=replicaregions_[touchable->GetCopyNumber(3)];
+		idx=replicatable_[r.offset+touchable->GetCopyNumber(2)*r.ny+touchable->GetCopyNumber(1)];
+	}
+	else{
+		idx=touchable->GetCopyNumber(1);
+	}
+	isabsorber=it->second;
+	return true;
+}
+
      
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -0,0 +1,93 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+//
+/// \file B4Digitizer.hh
+/// \brief Definition of the B4Digitizer class
+
+#ifndef B4Digitizer_h
+#define B4Digitizer_h 1
+
+#include "globals.hh"
+#include "sensorContainer.h"
+
+#include <vector>
+#include <set>
+
+class G4GenericMessenger;
+
+/// Digitization of the per-sensor energies.
+///
+/// Runs at the end of each event on the dense energy array in a single
+/// branch-free pass over all channels:
+/// - calibration with sensorContainer::getEnergyscalefactor()
+/// - Gaussian noise
+/// - ADC quantization and saturation
+/// - dead/noisy channel mask
+/// - zero suppression
+/// The per-channel gain and mask arrays are built in beginRun() from the
+/// settings under /B4/digi/, so changes take effect with the next run.
+
+class B4Digitizer
+{
+  public:
+    B4Digitizer();
+    ~B4Digitizer();
+
+    enum channelStatus{
+    	channel_ok=0,
+		channel_dead=1,
+		channel_noisy=2
+    };
+
+    G4bool isEnabled()const{return enabled_;}
+
+    void beginRun(const std::vector<sensorContainer>& sensors);
+
+    void process(std::vector<G4double>& energies, G4double threshold);
+
+    void maskDead(G4int detid){deadchannels_.insert(detid);}
+    void maskNoisy(G4int detid){noisychannels_.insert(detid);}
+    void clearMask(){deadchannels_.clear();noisychannels_.clear();}
+
+  private:
+    G4bool   enabled_;
+    G4bool   calibrate_;
+    G4double noise_;
+    G4double adclsb_;
+    G4int    adcsaturation_;
+
+    std::set<G4int> deadchannels_,noisychannels_;
+
+    //per-run channel arrays
+    std::vector<G4double> gain_;
+    std::vector<G4double> mask_;
+    std::vector<unsigned char> status_;
+    std::vector<G4double> noisebuffer_;
+
+    G4GenericMessenger* fMessenger;
+};
+
+#endif
@@ -0,0 +1,104 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+//
+/// \file B4EMShowerModel.hh
+/// \brief Definition of the B4EMShowerModel class
+
+#ifndef B4EMShowerModel_h
+#define B4EMShowerModel_h 1
+
+#include "G4VFastSimulationModel.hh"
+#include "G4SystemOfUnits.hh"
+
+class B4DetectorConstruction;
+
+/// Settings of the EM shower parameterisation, /B4/fastsim/ commands of
+/// B4DetectorConstruction. The model reads them at every trigger, so all
+/// but enable can be changed between runs.
+struct B4EMShowerParameters
+{
+  B4EMShowerParameters()
+  : enabled(false), electrons(true), positrons(true), photons(true),
+    minenergy(1.*GeV), spotenergy(20.*MeV), maxspots(20000),
+    energyscale(1.), longitudinalscale(1.), lateralscale(1.) {}
+
+  G4bool   enabled;       // create the model at /run/initialize
+  G4bool   electrons, positrons, photons;
+  G4double minenergy;     // below, the particle is tracked
+  G4double spotenergy;    // energy per deposited spot
+  G4int    maxspots;
+  G4double energyscale;   // deposited fraction of the shower energy
+  G4double longitudinalscale; // scales the shower depth
+  G4double lateralscale;  // scales core and tail radii
+};
+
+/// GFlash-style parameterisation of electromagnetic showers
+///
+/// Attached to the "Calorimeter", "Absorber" and "Active" regions, so a
+/// particle is parameterised where it is born. An electron, positron or
+/// photon above the minimum energy is killed and its energy deposited as
+/// spots into the sensors:
+/// - depth t (in X0) from the Gamma distribution of Grindhammer and Peters
+///   for homogeneous media, maximum at T = ln(E/Ec) - 0.858 (+1 for
+///   photons), shape alpha = 0.21 + (0.492 + 2.38/Z) ln(E/Ec)
+/// - radius from their two-component (core and tail) profile, in Moliere
+///   radii
+/// The material constants of the active material are combined from its
+/// elements with the PDG mixture rules: X0 from the material, Ec and RM
+/// from the elemental Rossi critical energies weighted by mass fraction
+/// over X0, Z as the mass weighted mean. For PbWO4 this gives X0 = 8.9 mm,
+/// Ec = 9.4 MeV and RM = 20 mm, the PDG values; the per-atom mean Z used
+/// before halved Ec and RM. The absorber fraction of the sandwiches is
+/// 1e-4 and neglected. Spots are assigned to sensors with
+/// B4DetectorConstruction::getSensorIndexAt(), spots outside the sensors
+/// count as leakage.
+/// energyscale, longitudinalscale and lateralscale correct the response,
+/// depth and width against full simulation. validateFastSim.C derives
+/// them from a full and a fast sample, see fastsim.mac.
+
+class B4EMShowerModel : public G4VFastSimulationModel
+{
+  public:
+    B4EMShowerModel(const G4String& name, G4Region* envelope,
+                    const B4DetectorConstruction* detector,
+                    const B4EMShowerParameters* parameters);
+    virtual ~B4EMShowerModel();
+
+    virtual G4bool IsApplicable(const G4ParticleDefinition& particle);
+    virtual G4bool ModelTrigger(const G4FastTrack& fastTrack);
+    virtual void DoIt(const G4FastTrack& fastTrack, G4FastStep& fastStep);
+
+  private:
+    const B4DetectorConstruction* fDetector;
+    const B4EMShowerParameters* fParameters;
+
+    G4double fX0;  // radiation length
+    G4double fRM;  // Moliere radius
+    G4double fEc;  // critical energy
+    G4double fZ;   // mean atomic number
+};
+
+#endif
@@ -0,0 +1,60 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+//
+/// \file B4EscapeSD.hh
+/// \brief Definition of the B4EscapeSD class
+
+#ifndef B4EscapeSD_h
+#define B4EscapeSD_h 1
+
+#include "G4VSensitiveDetector.hh"
+
+class G4Step;
+class G4HCofThisEvent;
+class B4aEventAction;
+
+/// Kill region outside the calorimeter envelope
+///
+/// Attached to the world volume. A step that starts on a geometry boundary
+/// in the world belongs to a track that just left the envelope: its kinetic
+/// energy is added to the leakage of the event and the track is killed
+/// instead of being transported through the world. Primaries starting in
+/// the world are not affected.
+
+class B4EscapeSD : public G4VSensitiveDetector
+{
+  public:
+    B4EscapeSD(const G4String& name);
+    virtual ~B4EscapeSD();
+
+    virtual void   Initialize(G4HCofThisEvent* hitCollection);
+    virtual G4bool ProcessHits(G4Step* step, G4TouchableHistory* history);
+
+  private:
+    B4aEventAction* fEventAction;
+};
+
+#endif
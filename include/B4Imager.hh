@@ -0,0 +1,90 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+//
+/// \file B4Imager.hh
+/// \brief Definition of the B4Imager class
+
+#ifndef B4Imager_h
+#define B4Imager_h 1
+
+#include "globals.hh"
+#include "sensorContainer.h"
+#include "npyWriter.h"
+
+#include <vector>
+
+class G4GenericMessenger;
+
+/// Resampling of the per-sensor energies to images of N x N pixels per
+/// layer, for networks that need a uniform grid.
+///
+/// The square grid covers the x-y extent of all sensors. At the beginning
+/// of the run the overlap of each sensor with each pixel is precomputed as
+/// a sparse matrix, one list of (pixel, area fraction) per sensor. At the
+/// end of the event the energies above threshold are spread over the
+/// pixels with that matrix, so the energy per layer is conserved.
+///
+/// The images are written to <prefix>_image.npy as a float32 array of
+/// shape (events, layers, N, N), pixel [layer][iy][ix], with the event
+/// numbers in <prefix>_image_event.npy. Layers are counted in increasing
+/// layer number. See /B4/image/.
+
+class B4Imager
+{
+  public:
+    B4Imager();
+    ~B4Imager();
+
+    G4bool isEnabled()const{return enabled_;}
+
+    //builds the matrix and opens the files, nevents is the expected number
+    void beginRun(const std::vector<sensorContainer>& sensors,
+    		const G4String& prefix, size_t nevents);
+    void endRun();
+
+    void process(const std::vector<G4double>& energies, G4double threshold,
+    		G4int event);
+
+  private:
+    void buildMatrix(const std::vector<sensorContainer>& sensors);
+
+    G4bool   enabled_;
+    G4int    pixels_;
+
+    //sensor i has the entries offsets_[i] to offsets_[i+1]
+    std::vector<size_t> offsets_;
+    std::vector<size_t> pixel_;
+    std::vector<float>  weight_;
+    size_t   nsensors_;
+    size_t   nlayers_;
+    G4int    matrixpixels_;
+
+    npyWriter image_, event_;
+
+    G4GenericMessenger* fMessenger;
+};
+
+#endif
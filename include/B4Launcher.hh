@@ -0,0 +1,95 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+//
+/// \file B4Launcher.hh
+/// \brief Definition of the B4Launcher class
+
+#ifndef B4Launcher_h
+#define B4Launcher_h 1
+
+#include "globals.hh"
+
+#include <vector>
+
+/// Multi-process launcher, exampleB4a -j N
+///
+/// Forks N processes before Geant4 is set up. Shard i gets
+/// - the output file <outfile>_j<i> and the log <outfile>_j<i>.log
+/// - the job seed for /B4/gun/seed and /B4/gun/shard i, so shard i runs
+///   the events iN to (i+1)N-1 of a single process job with N events per
+///   run, see B4PrimaryGeneratorAction. The output does not depend on the
+///   number of shards.
+/// - optionally one CPU: -c auto takes the CPUs of the launcher's affinity
+///   mask in turn, -c 0,2,4 a list. Memory is then allocated on the node of
+///   that CPU (first touch), which is the NUMA placement as well.
+/// Each shard reports its events and wall time through a pipe. The launcher
+/// waits for all of them and prints and writes <outfile>_summary.txt.
+
+class B4Launcher
+{
+  public:
+    B4Launcher(G4int njobs, const G4String& cpus,
+               const G4String& outfile, G4long seed);
+    ~B4Launcher();
+
+    /// true in a shard, which continues with the job. false in the
+    /// launcher once all shards have ended.
+    G4bool launch();
+
+    G4int    getShard() const { return fShard; }
+    G4String getOutputFile() const;
+
+    /// shard: send the job statistics to the launcher
+    void report(G4int events, G4double seconds);
+
+    /// launcher: 0 if all shards succeeded
+    G4int exitCode() const { return fExitCode; }
+
+  private:
+    struct shardStatus {
+      int    pid;
+      int    fd;
+      int    cpu;
+      G4int  events;
+      G4double seconds;
+      int    status;
+    };
+
+    std::vector<int> cpuList() const;
+    void pin(int cpu) const;
+    void summarise(G4double wallseconds);
+
+    G4int    fNJobs;
+    G4String fCpus;
+    G4String fOutfile;
+    G4long   fSeed;
+    G4int    fShard;
+    int      fReportFd;
+    G4int    fExitCode;
+    std::vector<shardStatus> fShards;
+};
+
+#endif
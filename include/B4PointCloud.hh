@@ -0,0 +1,110 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+//
+/// \file B4PointCloud.hh
+/// \brief Definition of the B4PointCloud class
+
+#ifndef B4PointCloud_h
+#define B4PointCloud_h 1
+
+#include "globals.hh"
+#include "sensorContainer.h"
+
+#include <vector>
+#include <utility>
+
+class G4GenericMessenger;
+
+/// Point-cloud output of the sensors above threshold with the indices of
+/// their k nearest fired neighbours, so graph networks do not have to
+/// build the kNN graph during training.
+///
+/// Distances are euclidean in (x, y, z) or, with the layer metric, in
+/// (x, y, layer x layerDistance). The static sensor positions are binned
+/// once into a uniform grid of buckets about the median sensor size.
+/// Per event only the fired sensors are sorted into their buckets and the
+/// search walks shells of buckets around each hit until no closer hit can
+/// be found. Small events are searched by brute force.
+///
+/// Per hit the columns pc_detid, pc_energy, pc_x, pc_y, pc_z and pc_layer
+/// are written, and k entries per hit in pc_knn (index of the neighbour in
+/// the pc_ columns, nearest first, -1 if there are fewer than k other hits)
+/// and pc_knn_distance. See /B4/pointcloud/.
+
+class B4PointCloud
+{
+	friend class B4RunAction;
+  public:
+    B4PointCloud();
+    ~B4PointCloud();
+
+    G4bool isEnabled()const{return enabled_;}
+
+    void process(const std::vector<G4double>& energies, G4double threshold,
+    		const std::vector<sensorContainer>& sensors);
+
+  private:
+    void buildIndex(const std::vector<sensorContainer>& sensors);
+    void setMetric(G4String metric);
+    size_t bucketKey(long bx, long by, long bz)const{
+    	return ((size_t)bx*nbuckets_[1]+by)*nbuckets_[2]+bz;
+    }
+    //adds hit j to the k nearest of hit i if it is closer than the furthest
+    void consider(size_t i, size_t j, size_t k);
+
+    G4bool   enabled_;
+    G4int    k_;
+    G4bool   layermetric_;
+    G4double layerdistance_;
+
+    //static index: metric position and bucket of each sensor
+    std::vector<float>  point_;
+    std::vector<long>   bucket_;
+    long     nbuckets_[3];
+    G4double bucketsize_;
+    size_t   indexedsensors_;
+    G4bool   indexedlayermetric_;
+    G4double indexedlayerdistance_;
+
+    //per-event output
+    std::vector<G4int> detid_;
+    std::vector<float> energy_;
+    std::vector<float> x_;
+    std::vector<float> y_;
+    std::vector<float> z_;
+    std::vector<G4int> layer_;
+    std::vector<G4int> knn_;
+    std::vector<float> knndistance_;
+
+    //work buffers
+    std::vector<size_t> hits_; //sensor index of each hit
+    std::vector<std::pair<size_t,size_t> > sortedhits_; //(bucket key, hit)
+    std::vector<std::pair<float,G4int> > heap_;
+
+    G4GenericMessenger* fMessenger;
+};
+
+#endif
@@ -37,6 +37,7 @@
 
 class G4ParticleGun;
 class G4Event;
+class G4GenericMessenger;
 
 /// The primary generator action class with particle gum.
 ///
@@ -44,6 +45,27 @@ class G4Event;
 /// perpendicular to the input face. The type of the particle
 /// can be changed via the G4 build-in commands of G4ParticleGun class 
 /// (see the macros provided with this example).
+///
+/// The gun fires from z=-200 cm, or from the front face of the calorimeter
+/// envelope with /B4/gun/startAtEnvelope true.
+///
+/// The random engine is reseeded at the start of every event from
+/// /B4/gun/seed (exampleB4a -s), the run ID and the event number, which is
+/// the event ID plus /B4/gun/eventOffset. The particle type alternates
+/// between pi0 (even) and gamma (odd event numbers) and no other state is
+/// kept between events. An event is therefore the same whichever thread or
+/// process simulates it: a run of 2N events and two jobs of N events with
+/// offsets 0 and N give the same events.
+/// /B4/gun/shard i (set by exampleB4a -j) adds i times the events of the
+/// run to the offset, so shard i of a job with N events per run simulates
+/// the events iN to (i+1)N-1 of one process running all of them. The event
+/// number is written to the event column. /random/setSeeds has no effect on
+/// the events.
+///
+/// /B4/gun/replay [run:]event (exampleB4a -e) re-simulates one event: all
+/// other events of the run(s) get no primaries and are not written, the
+/// replayed one is tracked with /B4/gun/replayVerbose and the run is
+/// aborted after it. The macro has to shoot at least event+1 events.
 
 
 
@@ -66,7 +88,11 @@ public:
   G4double getY()const{return yorig_;}
   G4double getR()const{return std::sqrt(yorig_*yorig_+xorig_*xorig_);}
 
-  static B4PrimaryGeneratorAction * globalgen;
+  //event ID plus the offset, the number the seed is derived from
+  G4int getEventNumber(const G4Event* event)const;
+  G4bool isReplaying()const{return replayevent_>=0;}
+  //true for the event selected with /B4/gun/replay
+  G4bool isReplayEvent(const G4Event* event)const;
 
   enum particles{
 	  elec=0,muon,pioncharged,pionneutral,klong,kshort,gamma,
@@ -87,9 +113,20 @@ private:
 
   G4String setParticleID(enum particles );
 
+  void seedEvent(const G4Event* event);
+  void setReplay(G4String spec);
+
   G4double energy_;
   G4double xorig_,yorig_;
   particles particleid_;
+  G4bool startatenvelope_;
+  G4long runseed_;
+  G4int eventoffset_;
+  G4int shard_;
+  G4int replayrun_;   //-1: any run
+  G4int replayevent_; //-1: no replay
+  G4int replayverbose_;
+  G4GenericMessenger* fMessenger;
 
 };
 
@@ -34,8 +34,13 @@
 #include "G4UserRunAction.hh"
 #include "globals.hh"
 #include "G4String.hh"
+#include "G4Accumulable.hh"
+#include "G4Timer.hh"
+#include "G4Threading.hh"
+#include <vector>
 
 class G4Run;
+class G4GenericMessenger;
 class B4PrimaryGeneratorAction;
 class B4aEventAction;
 /// Run action class
@@ -55,6 +60,17 @@ class B4aEventAction;
 /// In EndOfRunAction(), the accumulated statistic and computed 
 /// dispersion is printed.
 ///
+/// With /B4/bench/enable true the end of each run prints the event rate,
+/// the mean total deposited energy per event, its relative change to the
+/// reference run (the first benchmarked one, or the next one after
+/// /B4/bench/resetReference) and the production cuts of the calorimeter
+/// regions. See cutscan.mac.
+///
+/// With sharded output (exampleB4a -p tasks) the ntuples are not merged:
+/// every worker writes <file>_t<thread>.root and the master writes
+/// <file>_manifest.txt at the end of each run, one line per shard with the
+/// file name and its number of events. The master opens no output file.
+/// Every shard carries the sensors ntuple, so each can be read on its own.
 
 class B4RunAction : public G4UserRunAction
 {
@@ -72,13 +88,57 @@ class B4RunAction : public G4UserRunAction
     void setFileName(G4String fname){
     	fname_=fname;
     }
+    void setShardedOutput(G4bool sharded);
+    //file name without the .root extension
+    G4String baseFileName()const;
 
     virtual void BeginOfRunAction(const G4Run*);
     virtual void   EndOfRunAction(const G4Run*);
+
+    G4bool isBenchmarking()const{return benchmark_;}
+    //events of all runs so far, on the master or in sequential mode
+    G4int getEventsInJob()const{return eventsinjob_;}
+    void addEventEnergy(G4double e){
+    	edepsum_+=e;
+    	edepsum2_+=e*e;
+    }
+
   private:
+    //false for the master of a multi-threaded run
+    G4bool processesEvents()const{
+    	return !IsMaster() || !G4Threading::IsMultithreadedApplication();
+    }
+    void printBenchmark(const G4Run*);
+    void resetReference(){refedep_=-1;}
+
+    void bookNtuple();
+    void bookEventNtuple();
+    void bookSensorNtuple();
+    void fillSensorNtuple();
+    void writeManifest(const G4Run*);
+
+    struct shard{
+    	G4String file;
+    	G4int events;
+    };
+    //filled by the workers at the end of the run, read by the master
+    static std::vector<shard> shards_;
+
+    G4bool booked_;
+    G4int sensorntuple_;
+    std::vector<int> sensorneighbours_; //detids of the neighbours, per sensor row
     B4PrimaryGeneratorAction * generator_;
     B4aEventAction* eventact_;
     G4String fname_;
+    G4bool sharded_;
+    G4int eventsinjob_;
+
+    G4bool benchmark_;
+    G4Accumulable<G4double> edepsum_;
+    G4Accumulable<G4double> edepsum2_;
+    G4Timer runtimer_;
+    G4double refedep_; //<0: take the next run as reference
+    G4GenericMessenger* fMessenger;
 };
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
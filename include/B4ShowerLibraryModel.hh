@@ -0,0 +1,90 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+//
+/// \file B4ShowerLibraryModel.hh
+/// \brief Definition of the B4ShowerLibraryModel class
+
+#ifndef B4ShowerLibraryModel_h
+#define B4ShowerLibraryModel_h 1
+
+#include "G4VFastSimulationModel.hh"
+#include "G4SystemOfUnits.hh"
+
+class B4DetectorConstruction;
+class showerLibrary;
+
+/// Settings of the frozen shower library, /B4/showerlib/ commands of
+/// B4DetectorConstruction. The binning only applies to recording, a library
+/// that is used brings its own.
+struct B4ShowerLibraryParameters
+{
+  enum libraryMode { library_off, library_record, library_use };
+
+  B4ShowerLibraryParameters()
+  : mode(library_off), file("showerlib.bin"),
+    minenergy(10.*MeV), maxenergy(1.*GeV),
+    energybins(10), depthbins(10), maxperbin(100) {}
+
+  libraryMode mode;
+  G4String file;
+  G4double minenergy, maxenergy; // recorded range, maxenergy also caps use
+  G4int    energybins, depthbins;
+  G4int    maxperbin;            // showers recorded per bin
+};
+
+/// Frozen shower model
+///
+/// Attached to the "Calorimeter", "Absorber" and "Active" regions in
+/// library_use mode, so tracks are replaced where they are born. An
+/// electron, positron or photon inside the energy and depth range of the
+/// library (and below maxenergy) is killed and a random shower of its bin
+/// is stamped into the sensors: each deposit is moved to the track
+/// position and direction, scaled to the track energy and assigned with
+/// B4DetectorConstruction::getSensorIndexAt(). Deposits that miss the
+/// sensors count as leakage.
+/// The library is recorded in full simulation with library_record, see
+/// showerLibraryBuilder.
+
+class B4ShowerLibraryModel : public G4VFastSimulationModel
+{
+  public:
+    B4ShowerLibraryModel(const G4String& name, G4Region* envelope,
+                         const B4DetectorConstruction* detector,
+                         const showerLibrary* library,
+                         const B4ShowerLibraryParameters* parameters);
+    virtual ~B4ShowerLibraryModel();
+
+    virtual G4bool IsApplicable(const G4ParticleDefinition& particle);
+    virtual G4bool ModelTrigger(const G4FastTrack& fastTrack);
+    virtual void DoIt(const G4FastTrack& fastTrack, G4FastStep& fastStep);
+
+  private:
+    const B4DetectorConstruction* fDetector;
+    const showerLibrary* fLibrary;
+    const B4ShowerLibraryParameters* fParameters;
+};
+
+#endif
@@ -51,10 +51,15 @@ class B4aActionInitialization : public G4VUserActionInitialization
     void setFilename(G4String fname){
     	fname_=fname;
     }
+    //one output file per worker and a manifest instead of ntuple merging
+    void setShardedOutput(G4bool sharded){
+    	sharded_=sharded;
+    }
 
   private:
     B4DetectorConstruction* fDetConstruction;
     G4String fname_;
+    G4bool sharded_;
 };
 
 #endif
@@ -39,6 +39,19 @@
 #include "B4DetectorConstruction.hh"
 #include "G4Step.hh"
 #include "B4RunAction.hh"
+#include "primaryTruthAccumulator.h"
+#include "showerLibrary.h"
+#include "asyncEventWriter.h"
+#include "npyWriter.h"
+#include "B4Digitizer.hh"
+#include "B4Clusterer.hh"
+#include "B4Imager.hh"
+#include "B4PointCloud.hh"
+#include "G4Track.hh"
+
+#include <algorithm>
+#include <set>
+
 /// Event action class
 ///
 /// It defines data members to hold the energy deposit and track lengths
@@ -46,34 +59,150 @@
 /// - fEnergyAbs, fEnergyGap, fTrackLAbs, fTrackLGap
 /// which are collected step by step via the functions
 /// - AddAbs(), AddGap()
+///
+/// The per-sensor energies are written in one of two modes, selected with
+/// /B4/output/mode before the first run:
+/// - dense: one entry per sensor (rechit_* columns), entries below the
+///   threshold are set to zero
+/// - sparse: only sensors above threshold, as (hit_detid, hit_energy)
+///   pairs plus the number of hits nhits. The detid encodes layer and
+///   grid position (sensorContainer::makeDetID), the row of a detid in
+///   the "sensors" ntuple is its position in the dense view.
+/// The threshold is set with /B4/output/threshold.
+///
+/// Each row carries the event ID in the event column. With several threads
+/// the rows of the merged ntuple are not in event order, sorting by event
+/// gives the order of a sequential run with the same /B4/gun/seed.
+///
+/// The sensor geometry is written once per run to the "sensors" ntuple,
+/// one row per sensor in getActiveSensors() order. With
+/// /B4/output/staticGeometry true the dense event ntuple only carries
+/// rechit_energy, its entries following the row order of "sensors".
+///
+/// /B4/output/compact true replaces the is<Particle> columns by a single
+/// true_particle column holding the B4PrimaryGeneratorAction::particles
+/// enum and writes all rechit/hit quantities as float. Any column can be
+/// left out with /B4/output/dropColumn <name> before the first run.
+///
+/// The energies are digitized before the output if /B4/digi/enable is set,
+/// see B4Digitizer.
+///
+/// With /B4/output/primaryTruth true the fraction of each sensor's energy
+/// coming from each primary (and its descendants) is written sparsely as
+/// truth_detid, truth_primary, truth_fraction for sensors above threshold.
+///
+/// With /B4/det/killEscaping true (default) the kinetic energy of tracks
+/// leaving the calorimeter envelope is written per event as leakage.
+///
+/// With /B4/cluster/enable true the energies are clustered over the sensor
+/// neighbour graph and cluster_energy, cluster_x/y/z, cluster_width and
+/// cluster_ncells are written, see B4Clusterer.
+///
+/// With /B4/output/async true the event data are not filled into the B4
+/// ntuple but handed to a writer thread (asyncEventWriter) that writes them
+/// sparsely, above threshold, to <file>[_t<thread>]_run<run>.events. The
+/// sensors ntuple is still written, the B4 ntuple is not booked. In dense
+/// mode every sensor is written, zero below threshold. The dropped track
+/// totals are part of each record. /B4/output/asyncQueueSize sets the
+/// number of events in flight. Primary truth, clusters and the point cloud
+/// are not serialised, the run is stopped if they are enabled together
+/// with async. The mode is fixed by the first run.
+///
+/// With /B4/output/npy true the events are written as dense float32 arrays
+/// to <file>[_t<thread>]_run<run>_<name>.npy, memory mapped so that each
+/// event is one copy into the file:
+/// - energy: events x sensors, entries below threshold set to zero
+/// - truth: events x (true_particle, true_energy, true_x, true_y, true_r,
+///   leakage)
+/// - event: the int32 event number of each row
+/// - sensors: int32 detids giving the sensor order of the energy columns
+/// - geometry: sensors x (x, y, z, layer, dimz, dimxy) in the same order
+/// The files are preallocated for the events of the run and truncated to
+/// the events written at its end. The ntuple is not filled in this mode.
+///
+/// With /B4/pointcloud/enable true the hits above threshold are written
+/// as pc_* columns with their k nearest neighbours, see B4PointCloud. Like
+/// the cluster columns they are not available with async or npy output.
+///
+/// With /B4/image/enable true the energies are also written as per-layer
+/// images, in any output mode, see B4Imager.
+///
+/// If B4aStackingAction drops secondaries (/B4/stack/ commands before the
+/// first run), their number and kinetic energy are written per event as
+/// dropped_tracks and dropped_energy and summed at the end of each run.
+/// Deposits of weighted tracks (neutron roulette) count with their weight.
+///
+/// With /B4/showerlib/mode record the showers of low-energy electrons and
+/// photons are collected per sensor and written to the library file at the
+/// end of each run, see showerLibraryBuilder. With several threads the
+/// workers merge their showers at the end of the run and the master writes
+/// the single library file.
 class G4VPhysicalVolume;
+class G4GenericMessenger;
+class B4aStackingAction;
 class B4aEventAction : public G4UserEventAction
 {
 	friend B4RunAction;
   public:
+    enum outputMode{
+    	output_dense,
+		output_sparse
+    };
+
     B4aEventAction();
     virtual ~B4aEventAction();
 
+    //called from B4RunAction::BeginOfRunAction on threads processing events
+    void beginRun();
+    //called from B4RunAction::EndOfRunAction
+    void endRun();
+    //called from B4RunAction::EndOfRunAction on the master of a multi-threaded run
+    void endMasterRun();
+
     virtual void  BeginOfEventAction(const G4Event* event);
     virtual void    EndOfEventAction(const G4Event* event);
     
     void AddEnergy(G4double de, G4double dl);
+
+    //energy of tracks leaving the calorimeter envelope, see B4EscapeSD
+    void addLeakage(G4double e){leakage_+=e;}
+
+    //secondaries killed by B4aStackingAction, energy weighted
+    void addDroppedTrack(G4double e){
+    	droppedtracks_++;
+    	droppedenergy_+=e;
+    }
+
+    //parameterised deposits, see B4EMShowerModel
+    void addFastSimEnergy(size_t idx, G4double e, G4int trackid);
     
 
-    void accumulateVolumeInfo(G4VPhysicalVolume *,const G4Step* );
+    //stepping readout, see B4DetectorConstruction::readout_stepping
+    void accumulateVolumeInfo(const G4VTouchable *,const G4Step* );
+
+    void registerTrack(const G4Track* track){
+    	if(primarytruth_)
+    		truth_.registerTrack(track->GetTrackID(),track->GetParentID());
+    	if(recordlibrary_)
+    		library_.registerTrack(track);
+    }
+    //null if the per-primary truth is disabled
+    primaryTruthAccumulator* getTruthAccumulator(){
+    	return primarytruth_ ? &truth_ : 0;
+    }
+    //null if no shower library is recorded
+    showerLibraryBuilder* getShowerLibraryBuilder(){
+    	return recordlibrary_ ? &library_ : 0;
+    }
 
+    //resets the energies, the static sensor information is kept
     void clear(){
-    	rechit_energy_.clear();
+    	std::fill(rechit_energy_.begin(),rechit_energy_.end(),0);
     	allvolumes_.clear();
-    	rechit_absorber_energy_.clear();
-        rechit_x_.clear();
-        rechit_y_.clear();
-        rechit_z_.clear();
-        rechit_vz_.clear();
-        rechit_varea_.clear();
-        rechit_vxy_.clear();
-        rechit_layer_.clear();
-        rechit_detid_.clear();
+    	std::fill(rechit_absorber_energy_.begin(),rechit_absorber_energy_.end(),0);
+        hit_detid_.clear();
+        hit_energy_.clear();
+        hit_energy_f_.clear();
     }
 
     void setGenerator(B4PrimaryGeneratorAction * generator){
@@ -82,8 +211,32 @@ class B4aEventAction : public G4UserEventAction
     void setDetector(B4DetectorConstruction * detector){
     	detector_=detector;
     }
+    void setStackingAction(B4aStackingAction * stacking){
+    	stacking_=stacking;
+    }
+
+    outputMode getOutputMode()const{return outputmode_;}
+    G4bool writeStaticGeometryOnly()const{return staticgeometry_;}
+    G4bool isCompact()const{return compact_;}
+    G4bool isColumnEnabled(const G4String& name)const{
+    	return droppedcolumns_.find(name)==droppedcolumns_.end();
+    }
+    G4double getThreshold()const{return threshold_;}
 
   private:
+    void prepareSensorVectors();
+    //sensitive detector readout, adds the calorimeter hits of the event
+    void accumulateHits(const G4Event* event);
+    void fillSparseHits();
+    void fillPrimaryTruth();
+    void submitAsync(const G4Event* event);
+    //<file>[_t<thread>]_run<run>, base name of the per-run output files
+    G4String runFilePrefix()const;
+    void openNpy();
+    void writeNpy(const G4Event* event);
+    void setOutputMode(G4String mode);
+    void dropColumn(G4String name){droppedcolumns_.insert(name);}
+
     G4double  fEnergyAbs;
     std::vector<G4double>  rechit_energy_,rechit_absorber_energy_;
     std::vector<G4double>  rechit_x_;
@@ -96,13 +249,81 @@ class B4aEventAction : public G4UserEventAction
     std::vector<int>       rechit_detid_;
     std::vector<const G4VPhysicalVolume * > allvolumes_;
 
+    //float copies for the compact schema, geometry is filled once
+    std::vector<float>  rechit_energy_f_;
+    std::vector<float>  rechit_x_f_;
+    std::vector<float>  rechit_y_f_;
+    std::vector<float>  rechit_z_f_;
+    std::vector<float>  rechit_layer_f_;
+    std::vector<float>  rechit_vz_f_;
+    std::vector<float>  rechit_varea_f_;
+    std::vector<float>  rechit_vxy_f_;
+
+    std::vector<int>       hit_detid_;
+    std::vector<G4double>  hit_energy_;
+    std::vector<float>     hit_energy_f_;
+
+    B4Digitizer digitizer_;
+    B4Clusterer clusterer_;
+    B4Imager imager_;
+    B4PointCloud pointcloud_;
+
+    primaryTruthAccumulator truth_;
+    std::vector<int>       truth_detid_;
+    std::vector<int>       truth_primary_;
+    std::vector<float>     truth_fraction_;
+
+    showerLibraryBuilder library_;
+    //showers of all workers, written by the master
+    static showerLibraryBuilder mergedlibrary_;
+
+    asyncEventWriter writer_;
+
+    npyWriter npyenergy_, npytruth_, npyevent_;
+
     G4double  fEnergyGap;
+    G4double  leakage_;
+    G4int     droppedtracks_;
+    G4double  droppedenergy_;
+    G4int     rundroppedtracks_;
+    G4double  rundroppedenergy_;
+    G4int     runevents_;
     G4double  fTrackLAbs; 
     G4double  fTrackLGap;
 
+    //column ids, -1 if not booked
+    std::vector<G4int> ntuple_isparticle_;
+    G4int     ntuple_true_particle_;
+    G4int     ntuple_true_energy_;
+    G4int     ntuple_true_x_;
+    G4int     ntuple_true_y_;
+    G4int     ntuple_true_r_;
+    G4int     ntuple_nhits_;
+    G4int     ntuple_leakage_;
+    G4int     ntuple_event_;
+    G4int     ntuple_dropped_tracks_;
+    G4int     ntuple_dropped_energy_;
+    //id of the B4 ntuple, -1 if it is not booked (async output)
+    G4int     eventntuple_;
+    G4int     fHCID;
+
+    outputMode outputmode_;
+    G4double  threshold_;
+    G4bool    staticgeometry_;
+    G4bool    compact_;
+    G4bool    primarytruth_;
+    G4int     maxprimaries_;
+    G4bool    recordlibrary_;
+    G4bool    async_;
+    G4int     asyncqueuesize_;
+    G4bool    npy_;
+    std::set<G4String> droppedcolumns_;
+    G4GenericMessenger* fMessenger;
 
     B4PrimaryGeneratorAction * generator_;
     B4DetectorConstruction * detector_;
+    B4RunAction * runaction_;
+    B4aStackingAction * stacking_;
 
 };
 
@@ -0,0 +1,94 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+//
+/// \file B4aStackingAction.hh
+/// \brief Definition of the B4aStackingAction class
+
+#ifndef B4aStackingAction_h
+#define B4aStackingAction_h 1
+
+#include "G4UserStackingAction.hh"
+#include "globals.hh"
+
+#include <cfloat>
+#include <map>
+#include <unordered_map>
+
+class B4aEventAction;
+class G4GenericMessenger;
+class G4ParticleDefinition;
+
+/// Stacking action class.
+///
+/// Throughput cuts on secondaries, set under /B4/stack/:
+/// - timeCut <particle|all> <value> <unit>: kill tracks created later
+/// - energyCut <particle|all> <value> <unit>: kill tracks with less kinetic
+///   energy
+/// A particle specific cut replaces the "all" cut of the same kind.
+/// - neutronRoulette, rouletteEnergy, rouletteSurvival: neutrons below the
+///   energy survive with the given probability and carry the inverse as
+///   weight. The readout multiplies the deposits by the track weight.
+/// Primaries are never dropped. The number and kinetic energy of the
+/// dropped tracks are counted in B4aEventAction.
+
+class B4aStackingAction : public G4UserStackingAction
+{
+public:
+  B4aStackingAction(B4aEventAction* eventAction);
+  virtual ~B4aStackingAction();
+
+  virtual G4ClassificationOfNewTrack ClassifyNewTrack(const G4Track* track);
+
+  //true if any cut or the roulette is set
+  G4bool isActive() const;
+
+private:
+  struct speciesCuts {
+    speciesCuts() : maxtime(DBL_MAX), minenergy(0.) {}
+    G4double maxtime;
+    G4double minenergy;
+  };
+
+  void setTimeCut(G4String command);
+  void setEnergyCut(G4String command);
+  //parses "<particle> <value> <unit>", false with a message if malformed
+  G4bool parseCut(const G4String& command, G4String& particle, G4double& value) const;
+  const speciesCuts& getCuts(const G4ParticleDefinition* particle);
+
+  B4aEventAction*  fEventAction;
+  G4GenericMessenger* fMessenger;
+
+  std::map<G4String,speciesCuts> fCuts;  // by particle name, "all" for any
+  std::unordered_map<const G4ParticleDefinition*,speciesCuts> fResolved;
+
+  G4bool   fRoulette;
+  G4double fRouletteEnergy;
+  G4double fRouletteSurvival;
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
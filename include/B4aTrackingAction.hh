@@ -0,0 +1,56 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+//
+/// \file B4aTrackingAction.hh
+/// \brief Definition of the B4aTrackingAction class
+
+#ifndef B4aTrackingAction_h
+#define B4aTrackingAction_h 1
+
+#include "G4UserTrackingAction.hh"
+
+class B4aEventAction;
+
+/// Tracking action class.
+///
+/// In PreUserTrackingAction() the primary ancestor of each new track is
+/// registered in B4aEventAction, for the per-primary truth output.
+
+class B4aTrackingAction : public G4UserTrackingAction
+{
+public:
+  B4aTrackingAction(B4aEventAction* eventAction);
+  virtual ~B4aTrackingAction();
+
+  virtual void PreUserTrackingAction(const G4Track* track);
+
+private:
+  B4aEventAction*  fEventAction;
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
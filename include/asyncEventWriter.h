@@ -0,0 +1,80 @@
+/*
+ * asyncEventWriter.h
+ *
+ * Output stage that takes serialisation and disk I/O off the simulation
+ * thread (/B4/output/async).
+ *
+ * A fixed pool of event records circulates between two spscQueues: the
+ * simulation thread takes a free record, swaps its finished buffers into
+ * it and queues it; the writer thread writes it and returns it to the free
+ * queue. The buffers keep their capacity, so nothing is allocated per
+ * event once the pool is warm. If all records are in flight the producer
+ * waits: this stall time, the queue depth at submission and the writer
+ * busy time are the sizing metrics printed at close().
+ *
+ * File layout, native endian:
+ *   "B4EV", uint32 version, uint32 number of sensors
+ *   per event: int32 event, int32 particle, int32 dropped tracks,
+ *              5 x float64 true energy, true x, true y, leakage,
+ *              dropped energy, uint32 n, n x int32 detid,
+ *              n x float32 energy
+ */
+
+#ifndef B4A_INCLUDE_ASYNCEVENTWRITER_H_
+#define B4A_INCLUDE_ASYNCEVENTWRITER_H_
+
+#include "globals.hh"
+#include "spscQueue.h"
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <cstdio>
+
+class asyncEventWriter{
+public:
+	struct eventRecord{
+		G4int event, particle, droppedtracks;
+		G4double trueenergy, truex, truey, leakage, droppedenergy;
+		std::vector<int> detid;
+		std::vector<float> energy;
+	};
+
+	asyncEventWriter();
+	~asyncEventWriter();
+
+	//starts the writer thread, false if the file cannot be opened
+	bool open(const std::string& filename, size_t nsensors, size_t queuesize);
+	//drains the queue, joins the writer and prints the metrics
+	void close();
+	bool isOpen()const{return file_!=0;}
+
+	//a free record, waits while all records are queued
+	eventRecord* acquire();
+	void submit(eventRecord* record);
+
+private:
+	asyncEventWriter(const asyncEventWriter&);
+	asyncEventWriter& operator=(const asyncEventWriter&);
+
+	void writerLoop();
+	void write(const eventRecord& record);
+
+	std::FILE* file_;
+	std::string filename_;
+	std::vector<eventRecord> pool_;
+	spscQueue<eventRecord*>* full_;
+	spscQueue<eventRecord*>* free_;
+	std::thread writer_;
+	std::atomic<bool> stop_;
+
+	//producer side
+	size_t nsubmitted_, depthsum_, maxdepth_;
+	double stallseconds_;
+	//writer side, read after join
+	double busyseconds_;
+	size_t bytes_;
+};
+
+#endif /* B4A_INCLUDE_ASYNCEVENTWRITER_H_ */
@@ -0,0 +1,50 @@
+/*
+ * constructionProfiler.h
+ *
+ * Wall time and geometry store growth per construction phase.
+ *
+ * Phases are consecutive: begin() closes the running phase. The number of
+ * solids, logical and physical volumes created in a phase is taken from
+ * the Geant4 stores, the number of sensors is given by the caller.
+ */
+
+#ifndef B4A_INCLUDE_CONSTRUCTIONPROFILER_H_
+#define B4A_INCLUDE_CONSTRUCTIONPROFILER_H_
+
+#include "globals.hh"
+#include "G4Timer.hh"
+#include <vector>
+
+class constructionProfiler{
+public:
+	constructionProfiler():running_(false){}
+
+	void clear();
+
+	void begin(const G4String& name, size_t nsensors);
+	void end(size_t nsensors);
+
+	//one summary table, phases with the same name prefix are not merged
+	void print()const;
+
+private:
+	struct counts{
+		counts():solids(0),logical(0),physical(0),sensors(0){}
+		size_t solids,logical,physical,sensors;
+	};
+	struct phase{
+		G4String name;
+		G4double seconds;
+		counts created;
+	};
+	counts current(size_t nsensors)const;
+
+	std::vector<phase> phases_;
+	G4Timer timer_;
+	counts start_;
+	G4String runningname_;
+	bool running_;
+};
+
+
+#endif /* B4A_INCLUDE_CONSTRUCTIONPROFILER_H_ */
@@ -0,0 +1,65 @@
+/*
+ * npyWriter.h
+ *
+ * .npy array of rows of 4 byte little endian float32 or int32, written
+ * through a shared memory map. A row is a vector of columns or, with a
+ * row shape, a C-ordered tensor.
+ *
+ * The file is preallocated for the expected number of rows and grown by
+ * doubling when they are exceeded, so adding a row is a pointer increment
+ * and a copy into the mapping. close() writes the final shape into the
+ * header and truncates the file to the rows written. The header is padded
+ * to a fixed length, so rewriting the shape never moves the data.
+ * Readers can np.load(..., mmap_mode='r') without parsing.
+ */
+
+#ifndef B4A_INCLUDE_NPYWRITER_H_
+#define B4A_INCLUDE_NPYWRITER_H_
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+class npyWriter{
+public:
+	enum dataType{
+		type_float32,
+		type_int32
+	};
+
+	npyWriter();
+	~npyWriter();
+
+	//false with a message if the file cannot be created or mapped
+	bool open(const std::string& filename, dataType type, size_t columns, size_t rows);
+	//array shape (rows, rowshape[0], rowshape[1], ...)
+	bool open(const std::string& filename, dataType type,
+			const std::vector<size_t>& rowshape, size_t rows);
+	void close();
+	bool isOpen()const{return map_!=0;}
+
+	//memory of the next row, valid until the next call
+	float* nextFloatRow(){return (float*)nextRow();}
+	int* nextIntRow(){return (int*)nextRow();}
+
+	size_t rows()const{return rows_;}
+
+private:
+	npyWriter(const npyWriter&);
+	npyWriter& operator=(const npyWriter&);
+
+	void* nextRow();
+	bool map(size_t capacity);
+	void writeHeader(char* header, size_t rows)const;
+
+	static const size_t headersize_=128;
+
+	std::string filename_;
+	dataType type_;
+	std::vector<size_t> rowshape_;
+	int fd_;
+	char* map_;
+	size_t columns_, rows_, capacity_;
+};
+
+#endif /* B4A_INCLUDE_NPYWRITER_H_ */
@@ -0,0 +1,70 @@
+/*
+ * primaryTruthAccumulator.h
+ *
+ * Per-primary energy contributions to each sensor.
+ *
+ * All buffers are flat and sized once per run, so add() never allocates.
+ * The energy of primary p in sensor s lives at energy_[p*nsensors+s],
+ * only the touched entries are reset at the beginning of the next event.
+ * The primary ancestor of each track is kept in a vector indexed by the
+ * track ID, filled from the tracking action before the track is stepped.
+ */
+
+#ifndef B4A_INCLUDE_PRIMARYTRUTHACCUMULATOR_H_
+#define B4A_INCLUDE_PRIMARYTRUTHACCUMULATOR_H_
+
+#include "globals.hh"
+#include <vector>
+
+class primaryTruthAccumulator{
+public:
+	primaryTruthAccumulator():nsensors_(0),nprimaries_(0){}
+
+	//no-op if the sizes did not change
+	void setup(size_t nsensors, size_t maxprimaries);
+
+	void newEvent();
+
+	//primaries (parentid 0) get the index trackid-1, in the order of the
+	//primary particles. Primaries beyond the maximum share the last index.
+	void registerTrack(G4int trackid, G4int parentid){
+		if((size_t)trackid>=ancestor_.size())
+			ancestor_.resize(2*trackid+1,0);
+		if(parentid==0){
+			size_t p=trackid-1;
+			ancestor_[trackid]= p<nprimaries_ ? p : nprimaries_-1;
+		}
+		else{
+			ancestor_[trackid]=ancestor_[parentid];
+		}
+	}
+
+	//zero deposits are ignored, they would mark an entry touched twice
+	void add(size_t sensor, G4int trackid, G4double energy){
+		if(energy<=0)
+			return;
+		size_t idx=ancestor_[trackid]*nsensors_+sensor;
+		if(energy_[idx]==0)
+			touched_.push_back(idx);
+		energy_[idx]+=energy;
+	}
+
+	/*
+	 * sparse output: for every sensor with sensorenergy above threshold,
+	 * one entry per contributing primary with its energy fraction
+	 */
+	void fillFractions(const std::vector<G4double>& sensorenergy,
+			G4double threshold,
+			std::vector<int>& sensor,
+			std::vector<int>& primary,
+			std::vector<float>& fraction);
+
+private:
+	size_t nsensors_,nprimaries_;
+	std::vector<unsigned int> ancestor_;
+	std::vector<G4double> energy_;
+	std::vector<size_t> touched_;
+	std::vector<G4double> sensorsum_;
+};
+
+#endif /* B4A_INCLUDE_PRIMARYTRUTHACCUMULATOR_H_ */
@@ -14,6 +14,23 @@
 class sensorContainer{
 public:
 
+	enum gridType{
+		grid_lg=0, //coarse grid over the full layer
+		grid_hg=1  //fine grid in the upper right quadrant
+	};
+
+	/*
+	 * detid bit fields: layer in bits 22-29, grid type in bits 20-21,
+	 * x and y index on that grid in bits 10-19 and 0-9
+	 */
+	static int makeDetID(int layer, int grid, int ix, int iy){
+		return (layer&0xff)<<22 | (grid&0x3)<<20 | (ix&0x3ff)<<10 | (iy&0x3ff);
+	}
+	static int detIDLayer(int detid){return (detid>>22)&0xff;}
+	static int detIDGrid(int detid){return (detid>>20)&0x3;}
+	static int detIDX(int detid){return (detid>>10)&0x3ff;}
+	static int detIDY(int detid){return detid&0x3ff;}
+
 	sensorContainer(G4VPhysicalVolume * vol,
 	G4double dimxy,G4double dimz,
 	G4double area,
@@ -23,9 +40,8 @@ public:
 	int layer, G4VPhysicalVolume * absvol=0):
 		vol_(vol),dimxy_(dimxy),dimz_(dimz),area_(area),
 		posx_(posx),posy_(posy),posz_(posz),energyscalefactor_(1),
-		layer_(layer),absvol_(absvol)
+		layer_(layer),global_detid_(-1),absvol_(absvol)
 	{
-		global_detid_=global_detid_counter_++;
 	}
 
 
@@ -78,11 +94,19 @@ public:
 		return global_detid_;
 	}
 
+	/*
+	 * sets the bit field detid from the layer and the grid position. The
+	 * detid only depends on the geometry, not on the construction order,
+	 * so it is the same on the master and all worker threads.
+	 */
+	void setGridPosition(int grid, int ix, int iy){
+		global_detid_=makeDetID(layer_,grid,ix,iy);
+	}
+
 private:
 	sensorContainer():vol_(0),dimxy_(0),dimz_(0),area_(0),
-		posx_(0),posy_(0),posz_(0),energyscalefactor_(1),absvol_(0){
-			global_detid_=global_detid_counter_++;
-		}
+		posx_(0),posy_(0),posz_(0),energyscalefactor_(1),layer_(0),
+		global_detid_(-1),absvol_(0){}
 
 	G4VPhysicalVolume * vol_;
 	G4double dimxy_;
@@ -101,8 +125,6 @@ private:
 
 	G4VPhysicalVolume *  absvol_;
 
-	static int global_detid_counter_;
-
 };
 
 
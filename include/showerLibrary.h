@@ -0,0 +1,177 @@
+/*
+ * showerLibrary.h
+ *
+ * Frozen showers of low-energy electrons and photons.
+ *
+ * A library shower lists the sensors a particle and its descendants
+ * deposited energy in, as offsets of the sensor centres from the start
+ * point of the particle in the frame of its direction (see frame()), with
+ * the fraction of the particle energy. Showers are binned in particle type
+ * (e+- or gamma), log energy and depth of the start point.
+ *
+ * The file is written by showerLibraryBuilder and read through a read-only
+ * memory map, so processes using the same library share one copy in the
+ * page cache. Layout, native endian:
+ *   header
+ *   bin table    [particle][energy bin][depth bin] -> first shower, count
+ *   shower table                                   -> first deposit, count
+ *   deposits     {dx, dy, dz, fraction} as float
+ */
+
+#ifndef B4A_INCLUDE_SHOWERLIBRARY_H_
+#define B4A_INCLUDE_SHOWERLIBRARY_H_
+
+#include "globals.hh"
+#include "G4ThreeVector.hh"
+#include "sensorContainer.h"
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <stdint.h>
+
+class G4Track;
+
+class showerLibrary{
+public:
+	enum particleType{
+		particle_electron=0, //and positrons
+		particle_photon,
+		particle_size
+	};
+
+	struct header{
+		char magic[4];
+		uint32_t version;
+		uint64_t geometryhash; //B4DetectorConstruction::configHash()
+		uint32_t nenergybins, ndepthbins;
+		double emin, emax;         //MeV, log bins
+		double depthmin, depthmax; //z in mm, linear bins
+		uint64_t nshowers, ndeposits;
+
+		size_t nBins()const{return (size_t)particle_size*nenergybins*ndepthbins;}
+		//-1 outside the range
+		int energyBin(double e)const;
+		int depthBin(double z)const;
+		size_t binIndex(int particle, int ebin, int dbin)const{
+			return ((size_t)particle*nenergybins+ebin)*ndepthbins+dbin;
+		}
+	};
+	struct bin{
+		uint64_t first;
+		uint64_t n;
+	};
+	struct shower{
+		uint64_t first;
+		uint32_t n;
+		float energy; //MeV, of the recorded particle
+	};
+	struct deposit{
+		float dx, dy, dz;
+		float fraction;
+	};
+
+	showerLibrary();
+	~showerLibrary();
+
+	//maps the file, false with a message if it is missing or malformed
+	bool open(const std::string& filename);
+	void close();
+	bool isOpen()const{return header_!=0;}
+
+	const header& getHeader()const{return *header_;}
+
+	//-1 for everything but e+-, gamma
+	static int particleType(const G4Track* track);
+
+	//transverse axes for a direction, the same for recording and stamping
+	static void frame(const G4ThreeVector& direction, G4ThreeVector& e1, G4ThreeVector& e2){
+		e1=direction.orthogonal().unit();
+		e2=direction.cross(e1);
+	}
+
+	size_t nShowers(int particle, int ebin, int dbin)const{
+		return bins_[header_->binIndex(particle,ebin,dbin)].n;
+	}
+	//random must be in [0,1). The bin must not be empty.
+	const shower& sample(int particle, int ebin, int dbin, double random)const{
+		const bin& b=bins_[header_->binIndex(particle,ebin,dbin)];
+		return showers_[b.first+(uint64_t)(random*b.n)];
+	}
+	const deposit* deposits(const shower& s)const{return deposits_+s.first;}
+
+	static const char magic[4];
+	static const uint32_t version=1;
+
+private:
+	showerLibrary(const showerLibrary&);
+	showerLibrary& operator=(const showerLibrary&);
+
+	void* map_;
+	size_t mapsize_;
+	const header* header_;
+	const bin* bins_;
+	const shower* showers_;
+	const deposit* deposits_;
+};
+
+/*
+ * production mode: every e+-/gamma inside the binning range that does not
+ * descend from a particle already being recorded starts a library shower,
+ * all deposits of its descendants are added to it. The showers are kept
+ * over all runs of the job and written at the end of each run. With
+ * several threads the workers' showers are merged into one builder that
+ * the master writes.
+ */
+class showerLibraryBuilder{
+public:
+	showerLibraryBuilder():maxperbin_(0),nshowers_(0){}
+
+	//binning, must not change within a job
+	void setup(const showerLibrary::header& binning, size_t maxperbin);
+
+	void newEvent();
+
+	//from the tracking action, before the track is stepped
+	void registerTrack(const G4Track* track);
+
+	void add(size_t sensor, G4int trackid, G4double energy){
+		if((size_t)trackid>=root_.size() || !root_[trackid])
+			return;
+		open_[root_[trackid]-1].energy[sensor]+=energy;
+	}
+
+	//converts the showers of the event to library showers
+	void endEvent(const std::vector<sensorContainer>& sensors);
+
+	/*
+	 * moves the recorded showers of another builder (a worker thread) into
+	 * this one, up to maxperbin per bin, and clears them in the other
+	 */
+	void merge(showerLibraryBuilder& other);
+
+	//temporary file and rename, as the sensor cache
+	bool write(const std::string& filename)const;
+
+	size_t nShowers()const{return nshowers_;}
+
+private:
+	struct openShower{
+		size_t bin;
+		G4double energy0;
+		G4ThreeVector origin, direction;
+		std::unordered_map<size_t,G4double> energy; //by sensor index
+	};
+	struct recordedShower{
+		float energy;
+		std::vector<showerLibrary::deposit> deposits;
+	};
+
+	showerLibrary::header binning_;
+	size_t maxperbin_;
+	size_t nshowers_;
+	std::vector<unsigned int> root_; //by track ID, 1+index in open_ or 0
+	std::vector<openShower> open_;
+	std::vector<std::vector<recordedShower> > recorded_; //by bin
+};
+
+#endif /* B4A_INCLUDE_SHOWERLIBRARY_H_ */
@@ -0,0 +1,66 @@
+/*
+ * spscQueue.h
+ *
+ * Bounded lock-free queue for exactly one producer and one consumer thread.
+ *
+ * Ring buffer of a power of two size. The producer only writes head_, the
+ * consumer only tail_, each on its own cache line. An element is published
+ * by the release store of head_ and taken over after the acquire load, so
+ * no lock is needed. push() and pop() never block, they return false on a
+ * full or empty queue and the caller decides how to wait.
+ */
+
+#ifndef B4A_INCLUDE_SPSCQUEUE_H_
+#define B4A_INCLUDE_SPSCQUEUE_H_
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+template<class T>
+class spscQueue{
+public:
+	//capacity is rounded up to a power of two
+	explicit spscQueue(size_t capacity):head_(0),tail_(0){
+		size_t size=1;
+		while(size<capacity)
+			size*=2;
+		buffer_.resize(size);
+		mask_=size-1;
+	}
+
+	bool push(const T& value){
+		size_t head=head_.load(std::memory_order_relaxed);
+		if(head-tail_.load(std::memory_order_acquire)>mask_)
+			return false;
+		buffer_[head&mask_]=value;
+		head_.store(head+1,std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T& value){
+		size_t tail=tail_.load(std::memory_order_relaxed);
+		if(tail==head_.load(std::memory_order_acquire))
+			return false;
+		value=buffer_[tail&mask_];
+		tail_.store(tail+1,std::memory_order_release);
+		return true;
+	}
+
+	//approximate if called while the other side is active
+	size_t size()const{
+		return head_.load(std::memory_order_acquire)-tail_.load(std::memory_order_acquire);
+	}
+	size_t capacity()const{return mask_+1;}
+
+private:
+	spscQueue(const spscQueue&);
+	spscQueue& operator=(const spscQueue&);
+
+	std::vector<T> buffer_;
+	size_t mask_;
+	alignas(64) std::atomic<size_t> head_;
+	alignas(64) std::atomic<size_t> tail_;
+};
+
+#endif /* B4A_INCLUDE_SPSCQUEUE_H_ */
@@ -0,0 +1,116 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+//
+/// \file B4CalorimeterSD.cc
+/// \brief Implementation of the B4CalorimeterSD class
+
+#include "B4CalorimeterSD.hh"
+#include "B4DetectorConstruction.hh"
+#include "B4aEventAction.hh"
+
+#include "G4HCofThisEvent.hh"
+#include "G4Step.hh"
+#include "G4SDManager.hh"
+#include "G4EventManager.hh"
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+B4CalorimeterSD::B4CalorimeterSD(
+                            const G4String& name,
+                            const G4String& hitsCollectionName,
+                            const B4DetectorConstruction* detector)
+ : G4VSensitiveDetector(name),
+   fHitsCollection(nullptr),
+   fDetConstruction(detector),
+   fTruth(nullptr),
+   fLibrary(nullptr)
+{
+  collectionName.insert(hitsCollectionName);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+B4CalorimeterSD::~B4CalorimeterSD()
+{}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void B4CalorimeterSD::Initialize(G4HCofThisEvent* hce)
+{
+  // Create hits collection, owned by G4HCofThisEvent
+  fHitsCollection
+    = new B4CalorHitsCollection(SensitiveDetectorName, collectionName[0]);
+
+  auto hcID
+    = G4SDManager::GetSDMpointer()->GetCollectionID(collectionName[0]);
+  hce->AddHitsCollection( hcID, fHitsCollection );
+
+  // only reset the sensors fired in the previous event
+  size_t nsensors=fDetConstruction->getActiveSensors()->size();
+  if(fHitIndex.size()!=nsensors){
+    fHitIndex.assign(nsensors,-1);
+    fFired.clear();
+  }
+  for(const auto& i: fFired)
+    fHitIndex[i]=-1;
+  fFired.clear();
+
+  // per-primary truth lives in the event action of this thread
+  auto eventAction = static_cast<B4aEventAction*>(
+      G4EventManager::GetEventManager()->GetUserEventAction());
+  fTruth = eventAction ? eventAction->getTruthAccumulator() : nullptr;
+  fLibrary = eventAction ? eventAction->getShowerLibraryBuilder() : nullptr;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool B4CalorimeterSD::ProcessHits(G4Step* step,
+                                     G4TouchableHistory*)
+{
+  // weighted tracks from the neutron roulette, see B4aStackingAction
+  auto edep = step->GetTotalEnergyDeposit()*step->GetTrack()->GetWeight();
+  if ( edep==0. ) return false;
+
+  size_t idx=0;
+  bool isabsorber=false;
+  if(!fDetConstruction->getSensorIndex(step->GetPreStepPoint()->GetTouchable(),
+                                       idx,isabsorber))
+    return false;
+
+  if(fHitIndex[idx]<0){
+    fHitIndex[idx] = fHitsCollection->insert(new B4CalorHit(idx)) - 1;
+    fFired.push_back(idx);
+  }
+  (*fHitsCollection)[fHitIndex[idx]]->Add(edep,isabsorber);
+  if(fTruth)
+    fTruth->add(idx,step->GetTrack()->GetTrackID(),edep);
+  if(fLibrary)
+    fLibrary->add(idx,step->GetTrack()->GetTrackID(),edep);
+
+  return true;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -0,0 +1,130 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+//
+/// \file B4Clusterer.cc
+/// \brief Implementation of the B4Clusterer class
+
+#include "B4Clusterer.hh"
+#include "B4DetectorConstruction.hh"
+
+#include "G4GenericMessenger.hh"
+#include "G4SystemOfUnits.hh"
+
+#include <cmath>
+#include <algorithm>
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+B4Clusterer::B4Clusterer()
+: enabled_(false),
+  seedthreshold_(1*MeV),
+  growththreshold_(0.1*MeV)
+{
+	fMessenger = new G4GenericMessenger(this,"/B4/cluster/","topological clustering");
+	fMessenger->DeclareProperty("enable",enabled_,
+			"cluster the sensor energies and write the cluster columns."
+			" Only effective before the first run.");
+	fMessenger->DeclarePropertyWithUnit("seedThreshold","MeV",seedthreshold_,
+			"minimum energy of a cluster seed");
+	fMessenger->DeclarePropertyWithUnit("growthThreshold","MeV",growththreshold_,
+			"minimum energy of a sensor to add its neighbours to the cluster");
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+B4Clusterer::~B4Clusterer()
+{
+	delete fMessenger;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void B4Clusterer::process(const std::vector<G4double>& energies, G4double cellthreshold,
+		const B4DetectorConstruction& detector){
+
+	energy_.clear();
+	x_.clear();
+	y_.clear();
+	z_.clear();
+	width_.clear();
+	ncells_.clear();
+
+	const auto& sensors=*detector.getActiveSensors();
+	const size_t n=std::min(energies.size(),sensors.size());
+
+	label_.assign(n,-1);
+	seeds_.clear();
+	for(size_t i=0;i<n;i++){
+		if(energies[i]>=seedthreshold_ && energies[i]>0)
+			seeds_.push_back(i);
+	}
+	std::sort(seeds_.begin(),seeds_.end(),[&energies](size_t a, size_t b){
+		return energies[a]>energies[b];});
+
+	for(size_t seed: seeds_){
+		if(label_[seed]>=0)
+			continue;
+		G4int cluster=energy_.size();
+		G4double esum=0, sx=0, sy=0, sz=0, sxx=0, syy=0;
+		G4int ncells=0;
+
+		label_[seed]=cluster;
+		stack_.assign(1,seed);
+		while(!stack_.empty()){
+			size_t i=stack_.back();
+			stack_.pop_back();
+			const auto& s=sensors[i];
+			G4double e=energies[i];
+			esum+=e;
+			sx+=e*s.getPosx();
+			sy+=e*s.getPosy();
+			sz+=e*s.getPosz();
+			sxx+=e*s.getPosx()*s.getPosx();
+			syy+=e*s.getPosy()*s.getPosy();
+			ncells++;
+			if(e<growththreshold_)
+				continue; //boundary sensor
+
+			size_t nneighbours=0;
+			const size_t* neighbours=detector.getNeighbours(i,nneighbours);
+			for(size_t k=0;k<nneighbours;k++){
+				size_t j=neighbours[k];
+				if(j>=n || label_[j]>=0 || energies[j]<cellthreshold)
+					continue;
+				label_[j]=cluster;
+				stack_.push_back(j);
+			}
+		}
+
+		G4double mx=sx/esum, my=sy/esum;
+		energy_.push_back(esum);
+		x_.push_back(mx);
+		y_.push_back(my);
+		z_.push_back(sz/esum);
+		width_.push_back(std::sqrt(std::max(0.,sxx/esum-mx*mx+syy/esum-my*my)));
+		ncells_.push_back(ncells);
+	}
+}
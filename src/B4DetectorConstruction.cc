@@ -38,22 +38,43 @@
 #include "G4PVPlacement.hh"
 #include "G4PVReplica.hh"
 #include "G4GlobalMagFieldMessenger.hh"
+#include "G4GenericMessenger.hh"
 #include "G4AutoDelete.hh"
+#include "G4Timer.hh"
+#include "G4Navigator.hh"
+#include "G4TouchableHistory.hh"
 
 #include "G4GeometryManager.hh"
 #include "G4PhysicalVolumeStore.hh"
 #include "G4LogicalVolumeStore.hh"
 #include "G4SolidStore.hh"
 
+#include "G4Region.hh"
+#include "G4ProductionCuts.hh"
+
 #include "G4VisAttributes.hh"
 #include "G4Colour.hh"
 
 #include "G4PhysicalConstants.hh"
 #include "G4SystemOfUnits.hh"
 
+#include "G4SDManager.hh"
+
 #include "sensorContainer.h"
+#include "B4CalorimeterSD.hh"
+#include "B4EscapeSD.hh"
+
+#include "G4RegionStore.hh"
+#include "G4VModularPhysicsList.hh"
+#include "G4FastSimulationPhysics.hh"
 
 #include <cstdlib>
+#include <cstdio>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
 
 static G4double epsilon=0.0*mm;
 
@@ -76,20 +97,106 @@ static G4String createString(const T& i){
 B4DetectorConstruction::B4DetectorConstruction()
 : G4VUserDetectorConstruction(),
   fCheckOverlaps(false),
+  readoutmode_(readout_sd),
+  readoutabsorber_(true),
   defaultMaterial(0),
   absorberMaterial(0),
   gapMaterial(0)
 
 {
-
+	benchmarksink_=0;
+	physicslist_=0;
+	fastsimphysics_=false;
+	worldPV_=0;
+	envelopeLV_=0;
+	envelopemargin_=1*mm;
+	killescaping_=true;
+	usereplicas_=false;
+	verbose_=0;
+	profilevoxels_=false;
+	geometry_=ecal_only_irregular;
+	absorberFractionEE=0.0001;
+	absorberFractionHB=absorberFractionEE;
+	thicknessEEoverride_=0;
+	thicknessHBoverride_=0;
+	fMessenger = new G4GenericMessenger(this,"/B4/det/","detector control");
+	fMessenger->DeclareMethod("benchmarkLookup",
+			&B4DetectorConstruction::benchmarkLookup,
+			"time the volume to sensor lookup against a linear scan")
+			.SetParameterName("nlookups",true)
+			.SetDefaultValue("1000000");
+	fMessenger->DeclareProperty("readoutAbsorber",readoutabsorber_,
+			"add absorber deposits to the sensor energy (sensitive detector readout)");
+	fMessenger->DeclareProperty("useReplicas",usereplicas_,
+			"build uniform sensor regions with G4PVReplica instead of one placement per sensor");
+	fMessenger->DeclareMethod("geometry",&B4DetectorConstruction::setGeometry,
+			"standard, homogenous, homogenous_ecal_only, ecal_only, hcal_only_irregular or ecal_only_irregular");
+	fMessenger->DeclareMethod("layerGranularity",&B4DetectorConstruction::setLayerGranularity,
+			"granularity per layer, e.g. \"8 12 16 16\", overrides the number of layers");
+	fMessenger->DeclareMethod("splitGranularity",&B4DetectorConstruction::setSplitGranularity,
+			"HG sensors per row in the upper right quadrant per layer (0: none, <0: LG size)");
+	fMessenger->DeclarePropertyWithUnit("thicknessEE","mm",thicknessEEoverride_,
+			"EE layer thickness (0: geometry default)");
+	fMessenger->DeclarePropertyWithUnit("thicknessHB","mm",thicknessHBoverride_,
+			"HB layer thickness (0: geometry default)");
+	fMessenger->DeclareProperty("sensorCache",sensorcache_,
+			"directory of the binary sensor table cache (empty: no caching)");
+	fMessenger->DeclarePropertyWithUnit("envelopeMargin","mm",envelopemargin_,
+			"clearance between the layers and the calorimeter envelope");
+	fMessenger->DeclareProperty("killEscaping",killescaping_,
+			"kill tracks leaving the calorimeter envelope and write their energy as leakage");
+	fMessenger->DeclareProperty("verbose",verbose_,
+			"construction printout: 0 summary, 1 layers and materials, 2 every sensor");
+	fMessenger->DeclareProperty("profileVoxelization",profilevoxels_,
+			"time the voxelization in an extra close/open pass after construction");
+
+	auto& fs=fastsimparameters_;
+	fFastSimMessenger = new G4GenericMessenger(this,"/B4/fastsim/","EM shower parameterisation");
+	fFastSimMessenger->DeclareMethod("enable",&B4DetectorConstruction::setFastSimEnabled,
+			"attach the EM shower model to the calorimeter regions (before /run/initialize)");
+	fFastSimMessenger->DeclareMethod("particles",&B4DetectorConstruction::setFastSimParticles,
+			"particles that are parameterised, any of e- e+ gamma, the others are tracked");
+	fFastSimMessenger->DeclarePropertyWithUnit("minEnergy","GeV",fs.minenergy,
+			"particles below are tracked");
+	fFastSimMessenger->DeclarePropertyWithUnit("spotEnergy","MeV",fs.spotenergy,
+			"energy per deposited spot");
+	fFastSimMessenger->DeclareProperty("maxSpots",fs.maxspots,
+			"maximum number of spots per shower");
+	fFastSimMessenger->DeclareProperty("energyScale",fs.energyscale,
+			"deposited fraction of the shower energy");
+	fFastSimMessenger->DeclareProperty("longitudinalScale",fs.longitudinalscale,
+			"scale factor of the shower depth");
+	fFastSimMessenger->DeclareProperty("lateralScale",fs.lateralscale,
+			"scale factor of the core and tail radii");
+
+	auto& sl=showerlibparameters_;
+	fShowerLibMessenger = new G4GenericMessenger(this,"/B4/showerlib/","frozen shower library");
+	fShowerLibMessenger->DeclareMethod("mode",&B4DetectorConstruction::setShowerLibraryMode,
+			"record: write the showers of low-energy e+-/gamma in full simulation,"
+			" use: replace them by library showers. Before /run/initialize.")
+			.SetCandidates("off record use");
+	fShowerLibMessenger->DeclareProperty("file",sl.file,
+			"library file, written at the end of each run when recording");
+	fShowerLibMessenger->DeclarePropertyWithUnit("minEnergy","MeV",sl.minenergy,
+			"lower edge of the recorded energy range");
+	fShowerLibMessenger->DeclarePropertyWithUnit("maxEnergy","MeV",sl.maxenergy,
+			"upper edge of the recorded energy range, particles above are always tracked");
+	fShowerLibMessenger->DeclareProperty("energyBins",sl.energybins,
+			"number of log energy bins when recording");
+	fShowerLibMessenger->DeclareProperty("depthBins",sl.depthbins,
+			"number of depth bins over the layer stack when recording");
+	fShowerLibMessenger->DeclareProperty("maxPerBin",sl.maxperbin,
+			"showers recorded per particle, energy and depth bin");
 }
 
 G4VPhysicalVolume* B4DetectorConstruction::Construct()
 {
-	//DefineGeometry(homogenous_ecal_only);
-	//DefineGeometry(hcal_only_irregular);
-	DefineGeometry(ecal_only_irregular);
+	//default ecal_only_irregular, see /B4/det/geometry
+	DefineGeometry(geometry_);
+	applyGeometryOverrides();
+	profiler_.clear();
 	// Define materials
+	profiler_.begin("materials",0);
 	DefineMaterials();
 
 	// Define volumes
@@ -220,27 +327,480 @@ void  B4DetectorConstruction::DefineGeometry(geometry g){
 	}
 }
 
+void B4DetectorConstruction::setGeometry(G4String name){
+	static const std::map<G4String,geometry> names={
+			{"standard",standard},
+			{"homogenous",homogenous},
+			{"homogenous_ecal_only",homogenous_ecal_only},
+			{"ecal_only",ecal_only},
+			{"hcal_only_irregular",hcal_only_irregular},
+			{"ecal_only_irregular",ecal_only_irregular}
+	};
+	auto it=names.find(name);
+	if(it==names.end()){
+		G4ExceptionDescription msg;
+		msg << "Unknown geometry "<< name <<", keeping the previous selection.";
+		G4Exception("B4DetectorConstruction::setGeometry()",
+				"MyCode0002", JustWarning, msg);
+		return;
+	}
+	geometry_=it->second;
+}
+
+static std::vector<G4int> parseIntList(const G4String& list){
+	std::vector<G4int> out;
+	std::istringstream in(list);
+	G4int v;
+	while(in >> v)
+		out.push_back(v);
+	return out;
+}
+
+void B4DetectorConstruction::setLayerGranularity(G4String list){
+	granularityoverride_=parseIntList(list);
+}
+
+void B4DetectorConstruction::setSplitGranularity(G4String list){
+	splitoverride_=parseIntList(list);
+}
+
+void B4DetectorConstruction::applyGeometryOverrides(){
+	bool changed=false;
+	if(granularityoverride_.size()){
+		G4int nlayers=granularityoverride_.size();
+		if(nofEELayers>nlayers)
+			nofEELayers=nlayers;
+		nofHB=nlayers-nofEELayers;
+		layerGranularity=granularityoverride_;
+		//new layers get as many HG cells per row in the quadrant as LG cells
+		//over the full width, i.e. HG cells of half the LG size. This is the
+		//ecal_only_irregular convention up to granularity 8 (coarser HG
+		//above), standard uses 2*granularity, a quarter of the LG size.
+		for(G4int i=layerSplitGranularity.size();i<nlayers;i++)
+			layerSplitGranularity.push_back(layerGranularity.at(i)<2 ? 0 : layerGranularity.at(i));
+		layerSplitGranularity.resize(nlayers);
+		changed=true;
+	}
+	if(splitoverride_.size()){
+		if(splitoverride_.size()!=layerGranularity.size()){
+			G4ExceptionDescription msg;
+			msg << "splitGranularity has "<< splitoverride_.size() << " entries for "
+					<< layerGranularity.size() << " layers.";
+			G4Exception("B4DetectorConstruction::applyGeometryOverrides()",
+					"MyCode0003", FatalException, msg);
+		}
+		layerSplitGranularity=splitoverride_;
+	}
+	if(thicknessEEoverride_>0){
+		layerThicknessEE=thicknessEEoverride_;
+		changed=true;
+	}
+	if(thicknessHBoverride_>0){
+		layerThicknessHB=thicknessHBoverride_;
+		changed=true;
+	}
+	if(changed)
+		calorThickness=nofEELayers*layerThicknessEE+nofHB*layerThicknessHB;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+/*
+ * FNV-1a over everything the sensor table depends on: geometry variant,
+ * layer layout, absorber fractions and materials. Bump the version when
+ * the layout code (ordering, cell sizes) changes.
+ */
+unsigned long long B4DetectorConstruction::configHash()const{
+	unsigned long long hash=14695981039346656037ULL;
+	auto add=[&hash](const void* data, size_t size){
+		const unsigned char* bytes=(const unsigned char*)data;
+		for(size_t i=0;i<size;i++){
+			hash^=bytes[i];
+			hash*=1099511628211ULL;
+		}
+	};
+	auto addString=[&add](const G4String& text){
+		add(text.data(),text.size()+1);
+	};
+	const G4int version=3;
+	add(&version,sizeof(version));
+	add(&geometry_,sizeof(geometry_));
+	add(&absorberFractionEE,sizeof(absorberFractionEE));
+	add(&absorberFractionHB,sizeof(absorberFractionHB));
+	for(const auto material: {defaultMaterial,absorberMaterial,gapMaterial})
+		addString(material ? material->GetName() : G4String("none"));
+	add(&nofEELayers,sizeof(nofEELayers));
+	add(&nofHB,sizeof(nofHB));
+	add(&layerThicknessEE,sizeof(layerThicknessEE));
+	add(&layerThicknessHB,sizeof(layerThicknessHB));
+	add(&calorSizeXY,sizeof(calorSizeXY));
+	add(layerGranularity.data(),layerGranularity.size()*sizeof(G4int));
+	add(layerSplitGranularity.data(),layerSplitGranularity.size()*sizeof(G4int));
+	return hash;
+}
+
+G4String B4DetectorConstruction::sensorCacheFile()const{
+	char hex[17];
+	snprintf(hex,sizeof(hex),"%016llx",configHash());
+	return sensorcache_+"/sensors_"+hex+".bin";
+}
+
+static const char sensorCacheMagic[4]={'B','4','S','C'};
+
+bool B4DetectorConstruction::readSensorCache(std::vector<cachedSensor>& sensors)const{
+	std::ifstream in(sensorCacheFile(),std::ios::binary);
+	if(!in)
+		return false;
+	char magic[4];
+	unsigned long long hash=0, nsensors=0;
+	in.read(magic,4);
+	in.read((char*)&hash,sizeof(hash));
+	in.read((char*)&nsensors,sizeof(nsensors));
+	if(!in || !std::equal(magic,magic+4,sensorCacheMagic) || hash!=configHash())
+		return false;
+	sensors.resize(nsensors);
+	in.read((char*)sensors.data(),nsensors*sizeof(cachedSensor));
+	if(!in){
+		sensors.clear();
+		return false;
+	}
+	return true;
+}
+
+/*
+ * written to a temporary file and renamed, so concurrent jobs never
+ * read a partial table
+ */
+void B4DetectorConstruction::writeSensorCache(const std::vector<G4double>& absfractions)const{
+	std::vector<cachedSensor> sensors;
+	sensors.reserve(activecells_.size());
+	for(const auto& c: activecells_){
+		cachedSensor s;
+		s.dimxy=c.getDimxy();
+		s.dimz=c.getDimz();
+		s.area=c.getArea();
+		s.posx=c.getPosx();
+		s.posy=c.getPosy();
+		s.posz=c.getPosz();
+		s.energyscale=c.getEnergyscalefactor();
+		s.absfraction=absfractions.at(c.getLayer());
+		s.layer=c.getLayer();
+		s.grid=sensorContainer::detIDGrid(c.getGlobalDetID());
+		s.ix=sensorContainer::detIDX(c.getGlobalDetID());
+		s.iy=sensorContainer::detIDY(c.getGlobalDetID());
+		sensors.push_back(s);
+	}
+	G4String file=sensorCacheFile();
+	G4String tmpfile=file+".tmp"+createString(getpid());
+	std::ofstream out(tmpfile,std::ios::binary);
+	unsigned long long hash=configHash(), nsensors=sensors.size();
+	out.write(sensorCacheMagic,4);
+	out.write((const char*)&hash,sizeof(hash));
+	out.write((const char*)&nsensors,sizeof(nsensors));
+	out.write((const char*)sensors.data(),nsensors*sizeof(cachedSensor));
+	out.close();
+	if(!out || std::rename(tmpfile.c_str(),file.c_str())){
+		std::remove(tmpfile.c_str());
+		G4cout << "could not write sensor cache "<< file << G4endl;
+		return;
+	}
+	G4cout << "wrote sensor cache "<< file << G4endl;
+}
+
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
 B4DetectorConstruction::~B4DetectorConstruction()
 { 
+	delete fMessenger;
+	delete fFastSimMessenger;
+	delete fShowerLibMessenger;
+}
+
+void B4DetectorConstruction::setShowerLibraryMode(G4String mode){
+	if(mode=="record")
+		showerlibparameters_.mode=B4ShowerLibraryParameters::library_record;
+	else if(mode=="use"){
+		showerlibparameters_.mode=B4ShowerLibraryParameters::library_use;
+		registerFastSimPhysics();
+	}
+	else
+		showerlibparameters_.mode=B4ShowerLibraryParameters::library_off;
+}
+
+void B4DetectorConstruction::getShowerLibraryBinning(showerLibrary::header& binning)const{
+	const auto& sl=showerlibparameters_;
+	binning.geometryhash=configHash();
+	binning.nenergybins=std::max(sl.energybins,1);
+	binning.ndepthbins=std::max(sl.depthbins,1);
+	binning.emin=sl.minenergy;
+	binning.emax=sl.maxenergy;
+	calorimeterExtent(binning.depthmin,binning.depthmax);
+}
+
+void B4DetectorConstruction::setFastSimEnabled(G4bool enable){
+	fastsimparameters_.enabled=enable;
+	if(enable)
+		registerFastSimPhysics();
+}
+
+void B4DetectorConstruction::registerFastSimPhysics(){
+	if(!physicslist_ || fastsimphysics_)
+		return;
+	auto fastsim=new G4FastSimulationPhysics();
+	fastsim->ActivateFastSimulation("e-");
+	fastsim->ActivateFastSimulation("e+");
+	fastsim->ActivateFastSimulation("gamma");
+	physicslist_->RegisterPhysics(fastsim);
+	fastsimphysics_=true;
+}
+
+void B4DetectorConstruction::setFastSimParticles(G4String list){
+	auto& fs=fastsimparameters_;
+	fs.electrons=fs.positrons=fs.photons=false;
+	std::istringstream in(list);
+	G4String name;
+	while(in >> name){
+		if(name=="e-") fs.electrons=true;
+		else if(name=="e+") fs.positrons=true;
+		else if(name=="gamma") fs.photons=true;
+		else
+			G4cout << "setFastSimParticles: "<< name << " is not parameterised" << G4endl;
+	}
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
+void B4DetectorConstruction::buildSensorLookup(){
+	sensorlookup_.clear();
+	for(const auto& c: sandwichcache_){
+		sensorlookup_[c.second.active]=false;
+		sensorlookup_[c.second.absorber]=true;
+	}
+}
 
 /*
- * creates a single sandwich tile in a layer
+ * Sensors in one layer are neighbours if their squares touch at an edge
+ * or a corner, which also connects LG and HG cells along the quadrant
+ * border. Sensors in adjacent layers are neighbours if their squares
+ * overlap in x-y. Candidates are found by a sweep over x-sorted layers.
  */
-G4VPhysicalVolume* B4DetectorConstruction::createSandwich(G4LogicalVolume* layerLV,
+void B4DetectorConstruction::buildNeighbourGraph(){
+	const G4double tolerance=1e-3*mm;
+
+	std::map<int,std::vector<size_t> > layers;
+	for(size_t i=0;i<activecells_.size();i++)
+		layers[activecells_[i].getLayer()].push_back(i);
+
+	std::map<int,G4double> maxdimxy;
+	for(auto& l: layers){
+		std::sort(l.second.begin(),l.second.end(),[this](size_t a, size_t b){
+			return activecells_[a].getPosx()<activecells_[b].getPosx();});
+		G4double maxdim=0;
+		for(size_t i: l.second)
+			maxdim=std::max(maxdim,activecells_[i].getDimxy());
+		maxdimxy[l.first]=maxdim;
+	}
+
+	std::vector<std::vector<size_t> > adjacency(activecells_.size());
+	auto connect=[&](const std::vector<size_t>& from, const std::vector<size_t>& to,
+			G4double tomaxdim, bool samelayer){
+		for(size_t i: from){
+			const auto& a=activecells_[i];
+			G4double reach=(a.getDimxy()+tomaxdim)/2+tolerance;
+			auto it=std::lower_bound(to.begin(),to.end(),a.getPosx()-reach,
+					[this](size_t j, G4double x){return activecells_[j].getPosx()<x;});
+			for(;it!=to.end() && activecells_[*it].getPosx()<=a.getPosx()+reach;++it){
+				size_t j=*it;
+				if(j==i)
+					continue;
+				const auto& b=activecells_[j];
+				G4double half=(a.getDimxy()+b.getDimxy())/2;
+				G4double dx=std::fabs(a.getPosx()-b.getPosx());
+				G4double dy=std::fabs(a.getPosy()-b.getPosy());
+				if(samelayer && dx<=half+tolerance && dy<=half+tolerance){
+					adjacency[i].push_back(j);
+				}
+				else if(!samelayer && dx<half-tolerance && dy<half-tolerance){
+					adjacency[i].push_back(j);
+					adjacency[j].push_back(i);
+				}
+			}
+		}
+	};
+	for(auto it=layers.begin();it!=layers.end();++it){
+		connect(it->second,it->second,maxdimxy[it->first],true);
+		auto next=std::next(it);
+		if(next!=layers.end() && next->first==it->first+1)
+			connect(it->second,next->second,maxdimxy[next->first],false);
+	}
+
+	neighbouroffsets_.assign(1,0);
+	neighbours_.clear();
+	for(auto& a: adjacency){
+		std::sort(a.begin(),a.end());
+		neighbours_.insert(neighbours_.end(),a.begin(),a.end());
+		neighbouroffsets_.push_back(neighbours_.size());
+	}
+	G4cout << "neighbour graph: "<< neighbours_.size() << " edges for "
+			<< activecells_.size() << " sensors" << G4endl;
+}
+
+void B4DetectorConstruction::buildSensorLocator(){
+	std::map<int,layerGrid> layers;
+	detidindex_.clear();
+	for(size_t i=0;i<activecells_.size();i++){
+		const auto& c=activecells_[i];
+		detidindex_[c.getGlobalDetID()]=i;
+		auto it=layers.find(c.getLayer());
+		if(it==layers.end()){
+			layerGrid g;
+			g.zmin=c.getPosz()-c.getDimz()/2;
+			g.zmax=c.getPosz()+c.getDimz()/2;
+			g.lgsize=0;
+			g.hgsize=0;
+			g.layer=c.getLayer();
+			it=layers.insert(std::make_pair(c.getLayer(),g)).first;
+		}
+		if(sensorContainer::detIDGrid(c.getGlobalDetID())==sensorContainer::grid_hg)
+			it->second.hgsize=c.getDimxy();
+		else
+			it->second.lgsize=c.getDimxy();
+	}
+	layergrids_.clear();
+	for(const auto& l: layers)
+		layergrids_.push_back(l.second);
+	std::sort(layergrids_.begin(),layergrids_.end(),[](const layerGrid& a, const layerGrid& b){
+		return a.zmin<b.zmin;});
+}
+
+bool B4DetectorConstruction::getSensorIndexAt(const G4ThreeVector& pos, size_t& idx)const{
+	//grids are relative to the layer centre
+	G4double x=pos.x()-caloorigin_.x();
+	G4double y=pos.y()-caloorigin_.y();
+	G4double half=calorSizeXY/2;
+	if(std::fabs(x)>=half || std::fabs(y)>=half)
+		return false;
+	//a few tens of layers, a linear scan is as fast as a bisection
+	for(const auto& g: layergrids_){
+		if(pos.z()<g.zmin)
+			return false;
+		if(pos.z()>=g.zmax)
+			continue;
+		if(g.hgsize>0 && x>=0 && y>=0){
+			auto it=detidindex_.find(sensorContainer::makeDetID(g.layer,sensorContainer::grid_hg,
+					(int)(x/g.hgsize),(int)(y/g.hgsize)));
+			if(it!=detidindex_.end()){
+				idx=it->second;
+				return true;
+			}
+		}
+		if(g.lgsize>0){
+			auto it=detidindex_.find(sensorContainer::makeDetID(g.layer,sensorContainer::grid_lg,
+					(int)((x+half)/g.lgsize),(int)((y+half)/g.lgsize)));
+			if(it!=detidindex_.end()){
+				idx=it->second;
+				return true;
+			}
+		}
+		return false;
+	}
+	return false;
+}
+
+bool B4DetectorConstruction::isActiveVolume(G4VPhysicalVolume* vol)const{
+	auto it=sensorlookup_.find(vol);
+	return it!=sensorlookup_.end() && !it->second;
+}
+
+/*
+ * The linear scan is the lookup without any index: the sensor whose box
+ * contains the point. With shared sandwich volumes a volume pointer no
+ * longer identifies a sensor, so the scan compares positions. Its cost
+ * grows with the number of sensors, the indexed lookup should not; run
+ * the command after /B4/det/layerGranularity changes to compare sizes.
+ */
+void B4DetectorConstruction::benchmarkLookup(G4int nlookups){
+	if(activecells_.empty() || !worldPV_ || nlookups<1){
+		G4cout << "benchmarkLookup: geometry not initialised" << G4endl;
+		return;
+	}
+	//touchables inside sensors and outside, as seen in the stepping
+	G4Navigator navigator;
+	navigator.SetWorldVolume(worldPV_);
+	std::vector<G4TouchableHistory*> probes;
+	std::vector<G4ThreeVector> positions;
+	for(size_t i=0;i<activecells_.size();i+=std::max((size_t)1,activecells_.size()/64)){
+		const auto& c=activecells_.at(i);
+		positions.push_back(G4ThreeVector(c.getPosx(),c.getPosy(),c.getPosz()+c.getDimz()/4));
+	}
+	positions.push_back(G4ThreeVector(0,0,-calorThickness));
+	for(const auto& pos: positions){
+		navigator.LocateGlobalPointAndSetup(pos,0,false);
+		probes.push_back(navigator.CreateTouchableHistory());
+	}
+
+	G4Timer timer;
+	size_t idx=0,sum=0;
+	bool isabsorber;
+	timer.Start();
+	for(G4int i=0;i<nlookups;i++){
+		if(getSensorIndex(probes[i%probes.size()],idx,isabsorber))
+			sum+=idx;
+	}
+	timer.Stop();
+	G4double indexed=timer.GetRealElapsed();
+
+	timer.Start();
+	for(G4int i=0;i<nlookups;i++){
+		const auto& pos=positions[i%positions.size()];
+		for(size_t j=0;j<activecells_.size();j++){
+			const auto& c=activecells_[j];
+			if(std::fabs(pos.x()-c.getPosx())<c.getDimxy()/2
+					&& std::fabs(pos.y()-c.getPosy())<c.getDimxy()/2
+					&& std::fabs(pos.z()-c.getPosz())<c.getDimz()/2){
+				sum+=j;
+				break;
+			}
+		}
+	}
+	timer.Stop();
+	G4double linear=timer.GetRealElapsed();
+	benchmarksink_=sum;//keep the loops from being optimised away
+
+	G4cout << "benchmarkLookup: "<< activecells_.size() << " sensors, "
+			<< nlookups << " lookups: indexed "<< indexed/nlookups*1e9 << " ns/lookup, "
+			<< "linear scan "<< linear/nlookups*1e9 << " ns/lookup"<< G4endl;
+
+	for(auto& p: probes)
+		delete p;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+
+/*
+ * builds the logical volume of a sandwich tile with its absorber and gap,
+ * once per shape and materials
+ */
+G4LogicalVolume* B4DetectorConstruction::getSandwichLV(
 		G4double dx,
 		G4double dy,
 		G4double dz,
-		G4ThreeVector position,
-		G4String name,
 		G4double absorberfraction,
+		G4VPhysicalVolume*& active,
 		G4VPhysicalVolume*& absorber){
 
+	sandwichKey key(dx,dy,dz,absorberfraction,
+			defaultMaterial,absorberMaterial,gapMaterial);
+	auto cached=sandwichcache_.find(key);
+	if(cached!=sandwichcache_.end()){
+		active=cached->second.active;
+		absorber=cached->second.absorber;
+		return cached->second.sandwich;
+	}
+
+	G4String name=createString(sandwichcache_.size());
+
 	auto absdz=absorberfraction*dz;
 	auto gapdz=(1-absorberfraction)*dz;
 
@@ -277,7 +837,7 @@ G4VPhysicalVolume* B4DetectorConstruction::createSandwich(G4LogicalVolume* layer
 			"Abso_"+name,           // its name
 			sandwichLV,          // its mother  volume
 			false,            // no boolean operation
-			0,                // copy number
+			1,                // copy number
 			fCheckOverlaps);  // checking overlaps
 
 
@@ -294,7 +854,7 @@ G4VPhysicalVolume* B4DetectorConstruction::createSandwich(G4LogicalVolume* layer
 			gapMaterial,      // its material
 			"Gap_"+name);           // its name
 
-	auto activeMaterial
+	active
 	= new G4PVPlacement(
 			0,                // no rotation
 			G4ThreeVector(0., 0., gapdz/2), // its position
@@ -305,6 +865,27 @@ G4VPhysicalVolume* B4DetectorConstruction::createSandwich(G4LogicalVolume* layer
 			0,                // copy number
 			fCheckOverlaps);  // checking overlaps
 
+	sandwichcache_[key]={sandwichLV,active,absorber};
+	return sandwichLV;
+}
+
+/*
+ * creates a single sandwich tile in a layer
+ * the copy number is the index of the sensor in activecells_
+ */
+G4VPhysicalVolume* B4DetectorConstruction::createSandwich(G4LogicalVolume* layerLV,
+		G4double dx,
+		G4double dy,
+		G4double dz,
+		G4ThreeVector position,
+		G4String name,
+		G4double absorberfraction,
+		G4VPhysicalVolume*& absorber,
+		G4int copyno){
+
+	G4VPhysicalVolume* activeMaterial=0;
+	auto sandwichLV=getSandwichLV(dx,dy,dz,absorberfraction,activeMaterial,absorber);
+
 	//place the sandwich
 
 	//auto sandwichPV =
@@ -315,7 +896,7 @@ G4VPhysicalVolume* B4DetectorConstruction::createSandwich(G4LogicalVolume* layer
 				"Sandwich_"+name,           // its name
 				layerLV,          // its mother  volume
 				false,            // no boolean operation
-				0,                // copy number
+				copyno,           // copy number
 				fCheckOverlaps);  // checking overlaps
 
 	return activeMaterial;
@@ -323,12 +904,56 @@ G4VPhysicalVolume* B4DetectorConstruction::createSandwich(G4LogicalVolume* layer
 
 }
 
-G4VPhysicalVolume* B4DetectorConstruction::createLayer(G4LogicalVolume * caloLV,
+/*
+ * places an nx x ny block of identical sandwiches with its lower corner at
+ * lowercorner (layer frame): a replica of columns along x, each a replica of
+ * cells along y. The caller fills the sensor indices in replicatable_.
+ */
+G4int B4DetectorConstruction::createReplicaRegion(G4LogicalVolume* layerLV,
+		G4ThreeVector lowercorner,
+		G4int nx, G4int ny,
+		G4double sensorsize,
 		G4double thickness,
-		G4int granularity, G4double absfraction,G4ThreeVector position,
-		G4String name, int layernumber, G4double calibration, G4int    nsmallsensorsrow){
+		G4double absorberfraction){
+
+	G4VPhysicalVolume* active=0, *absorber=0;
+	auto sandwichLV=getSandwichLV(sensorsize,sensorsize,thickness,
+			absorberfraction,active,absorber);
+
+	G4int regionid=replicaregions_.size();
+	G4String name="Region_"+createString(regionid);
 
+	auto columnS = new G4Box("Column_"+name,
+			sensorsize/2, ny*sensorsize/2, thickness/2);
+	auto columnLV = new G4LogicalVolume(columnS,defaultMaterial,"Column_"+name);
+	new G4PVReplica("Cell_"+name,sandwichLV,columnLV,kYAxis,ny,sensorsize);
 
+	auto regionS = new G4Box(name,
+			nx*sensorsize/2, ny*sensorsize/2, thickness/2);
+	auto regionLV = new G4LogicalVolume(regionS,defaultMaterial,name);
+	new G4PVReplica("Column_"+name,columnLV,regionLV,kXAxis,nx,sensorsize);
+
+	new G4PVPlacement(
+			0,                // no rotation
+			lowercorner+G4ThreeVector(nx*sensorsize/2, ny*sensorsize/2, 0),
+			regionLV,         // its logical volume
+			name,             // its name
+			layerLV,          // its mother  volume
+			false,            // no boolean operation
+			regionid,         // copy number
+			fCheckOverlaps);  // checking overlaps
+
+	replicaRegion region;
+	region.offset=replicatable_.size();
+	region.ny=ny;
+	replicaregions_.push_back(region);
+	replicatable_.resize(region.offset+nx*ny,0);
+	return regionid;
+}
+
+G4LogicalVolume* B4DetectorConstruction::placeLayerVolume(G4LogicalVolume * caloLV,
+		G4double thickness, G4ThreeVector position, G4String name,
+		G4VPhysicalVolume*& layerPV){
 
 	auto layerS   = new G4Box("Layer_"+name,           // its name
 			calorSizeXY/2, calorSizeXY/2, thickness/2); // its size
@@ -338,7 +963,7 @@ G4VPhysicalVolume* B4DetectorConstruction::createLayer(G4LogicalVolume * caloLV,
 			defaultMaterial,  // its material
 			"Layer_"+name);         // its name
 
-	auto layerPV = new G4PVPlacement(
+	layerPV = new G4PVPlacement(
 			0,                // no rotation
 			position, // its position
 			layerLV,       // its logical volume
@@ -348,6 +973,19 @@ G4VPhysicalVolume* B4DetectorConstruction::createLayer(G4LogicalVolume * caloLV,
 			0,                // copy number
 			fCheckOverlaps);  // checking overlaps
 
+	return layerLV;
+}
+
+G4VPhysicalVolume* B4DetectorConstruction::createLayer(G4LogicalVolume * caloLV,
+		G4double thickness,
+		G4int granularity, G4double absfraction,G4ThreeVector position,
+		G4String name, int layernumber, G4double calibration, G4int    nsmallsensorsrow){
+
+
+
+	G4VPhysicalVolume* layerPV=0;
+	auto layerLV=placeLayerVolume(caloLV,thickness,position,name,layerPV);
+
 
 	G4double coarsedivider=(G4double)granularity;
 	G4double largesensordxy=calorSizeXY/coarsedivider;
@@ -373,6 +1011,7 @@ G4VPhysicalVolume* B4DetectorConstruction::createLayer(G4LogicalVolume * caloLV,
 	auto placeSensors = [] (
 			G4ThreeVector startcorner,
 			bool small,
+			int grid,
 			G4double sensorsize,
 			G4double Thickness,
 			int gran,
@@ -397,15 +1036,17 @@ G4VPhysicalVolume* B4DetectorConstruction::createLayer(G4LogicalVolume * caloLV,
 				auto activesensor=drec->createSandwich(layerlogV,sensorsize,sensorsize,
 						Thickness,sandwichposition,
 						lname+"_sensor_"+createString(xi)+"_"+createString(yi),
-						absfractio,absorber);
+						absfractio,absorber,acells->size());
 
 				sensorContainer sensordesc(activesensor,
 						sensorsize,Thickness,sensorsize*sensorsize,
 						patentpos.x()+posx,
 						patentpos.y()+posy,
 						patentpos.z(),laynum,absorber);
-				G4cout << "created sensor with ID "<< sensordesc.getGlobalDetID() << G4endl;
+				if(drec->verbose_>1)
+					G4cout << "created sensor with ID "<< sensordesc.getGlobalDetID() << G4endl;
 				sensordesc.setEnergyscalefactor(calib);
+				sensordesc.setGridPosition(grid,xi,yi);
 				acells->push_back(sensordesc);
 			}
 
@@ -418,34 +1059,113 @@ G4VPhysicalVolume* B4DetectorConstruction::createLayer(G4LogicalVolume * caloLV,
 			0);
 
 
+	//replicated regions need the LG area to split into a left half and
+	//a lower right quadrant; the sensor order is the same as below
+	if(usereplicas_ && (nsmallsensorsrow<=0 || granularity%2==0)){
+
+		auto addSensor=[&](G4int region, G4int ix, G4int iy,
+				G4double posx, G4double posy, G4double sensorsize,
+				G4int grid, G4int gridx, G4int gridy){
+			G4VPhysicalVolume* active=0, *absorber=0;
+			getSandwichLV(sensorsize,sensorsize,thickness,absfraction,active,absorber);
+			const replicaRegion& r=replicaregions_.at(region);
+			replicatable_.at(r.offset+ix*r.ny+iy)=activecells_.size();
+			sensorContainer sensordesc(active,
+					sensorsize,thickness,sensorsize*sensorsize,
+					caloorigin_.x()+position.x()+posx,
+					caloorigin_.y()+position.y()+posy,
+					caloorigin_.z()+position.z(),layernumber,absorber);
+			sensordesc.setEnergyscalefactor(calibration);
+			sensordesc.setGridPosition(grid,gridx,gridy);
+			activecells_.push_back(sensordesc);
+		};
+
+		G4int half=granularity/2;
+		G4int lgleft=-1, lgright=-1, hg=-1;
+		if(nsmallsensorsrow>0){
+			lgleft=createReplicaRegion(layerLV,lowerleftcorner,half,granularity,
+					largesensordxy,thickness,absfraction);
+			lgright=createReplicaRegion(layerLV,G4ThreeVector(0,-calorSizeXY/2,0),half,half,
+					largesensordxy,thickness,absfraction);
+			hg=createReplicaRegion(layerLV,G4ThreeVector(0,0,0),nsmallsensorsrow,nsmallsensorsrow,
+					smallsensordxy,thickness,absfraction);
+		}
+		else{
+			lgleft=createReplicaRegion(layerLV,lowerleftcorner,granularity,granularity,
+					largesensordxy,thickness,absfraction);
+		}
+		for(int xi=0;xi<granularity;xi++){
+			G4double posx=lowerleftcorner.x()+largesensordxy/2+largesensordxy*(G4double)xi;
+			for(int yi=0;yi<granularity;yi++){
+				G4double posy=lowerleftcorner.y()+largesensordxy/2+largesensordxy*(G4double)yi;
+				if(hg<0)
+					addSensor(lgleft,xi,yi,posx,posy,largesensordxy,
+							sensorContainer::grid_lg,xi,yi);
+				else if(xi<half)
+					addSensor(lgleft,xi,yi,posx,posy,largesensordxy,
+							sensorContainer::grid_lg,xi,yi);
+				else if(yi<half)
+					addSensor(lgright,xi-half,yi,posx,posy,largesensordxy,
+							sensorContainer::grid_lg,xi,yi);
+			}
+		}
+		for(int xi=0;hg>=0 && xi<nsmallsensorsrow;xi++){
+			G4double posx=smallsensordxy/2+smallsensordxy*(G4double)xi;
+			for(int yi=0;yi<nsmallsensorsrow;yi++){
+				G4double posy=smallsensordxy/2+smallsensordxy*(G4double)yi;
+				addSensor(hg,xi,yi,posx,posy,smallsensordxy,
+						sensorContainer::grid_hg,xi,yi);
+			}
+		}
+	}
 	//place LG sensors:
-	if(nsmallsensorsrow>0){
-		placeSensors(lowerleftcorner, false,largesensordxy,thickness,
+	else if(nsmallsensorsrow>0){
+		placeSensors(lowerleftcorner, false,sensorContainer::grid_lg,largesensordxy,thickness,
 				granularity,G4ThreeVector(0,0,0),name,&activecells_,layerLV,this,
-				position,absfraction,layernumber,calibration);
-		placeSensors(G4ThreeVector(0,0,0), true,smallsensordxy,thickness,
+				position+caloorigin_,absfraction,layernumber,calibration);
+		placeSensors(G4ThreeVector(0,0,0), true,sensorContainer::grid_hg,smallsensordxy,thickness,
 				nsmallsensorsrow,G4ThreeVector(0,0,0),name,&activecells_,layerLV,
-				this,position,absfraction,layernumber,calibration);
+				this,position+caloorigin_,absfraction,layernumber,calibration);
 	}
 	else{
 
-		placeSensors(lowerleftcorner, true,largesensordxy,thickness,
+		placeSensors(lowerleftcorner, true,sensorContainer::grid_lg,largesensordxy,thickness,
 				granularity,G4ThreeVector(0,0,0),name,&activecells_,layerLV,this,
-				position,absfraction,layernumber,calibration);
+				position+caloorigin_,absfraction,layernumber,calibration);
 	}
-	G4cout << "layer position="<<position <<G4endl;
+	if(verbose_>0)
+		G4cout << "layer position="<<position <<G4endl;
 
 	return layerPV;
 
 }
 
+void B4DetectorConstruction::calorimeterExtent(G4double& front, G4double& back)const{
+	G4double lastzpos=-layerThicknessEE;
+	front=0;
+	back=0;
+	for(int i=0;i<nofEELayers+nofHB;i++){
+		G4double thickness= i>=nofEELayers ? layerThicknessHB : layerThicknessEE;
+		G4double center=lastzpos+thickness;
+		if(i==0)
+			front=center-thickness/2;
+		back=center+thickness/2;
+		lastzpos+=thickness;
+	}
+}
+
 void B4DetectorConstruction::createCalo(G4LogicalVolume * caloLV,G4ThreeVector position,G4String name){
 
-	G4double absorberFractionEE=0.0001;
-	G4double absorberFractionHB=absorberFractionEE;
 	G4double calibrationEE=1;
 	G4double calibrationHB=1;
 
+	std::vector<cachedSensor> cached;
+	if(sensorcache_.size() && !usereplicas_ && readSensorCache(cached)){
+		createCaloFromCache(caloLV,position,name,cached);
+		return;
+	}
+	std::vector<G4double> layerabsfraction;
+
 //define the geometries
 
 
@@ -463,18 +1183,60 @@ void B4DetectorConstruction::createCalo(G4LogicalVolume * caloLV,G4ThreeVector p
 			calibration=calibrationHB;
 		}
 		G4ThreeVector createatposition=G4ThreeVector(0,0,lastzpos+thickness)+position;
+		profiler_.begin("layer "+createString(i),activecells_.size());
 		createLayer(
 				caloLV,thickness,
 				granularity,
 				absfraction,
 				createatposition,
 				name+"layer"+createString(i),i,1,splitgranularity);//calibration);
-		G4cout << "created layer "<<  i<<" at "<< createatposition << G4endl;
+		if(verbose_>0)
+			G4cout << "created layer "<<  i<<" at "<< createatposition << G4endl;
 		lastzpos+=thickness;
+		layerabsfraction.push_back(absfraction);
 	}
 
 	G4cout << "created " << activecells_.size() << " sensors"<<std::endl;
+	if(sensorcache_.size())
+		writeSensorCache(layerabsfraction);
+
+}
 
+/*
+ * places layers and sandwiches directly from a cached sensor table,
+ * in the same order as createLayer, so detids and copy numbers agree
+ */
+void B4DetectorConstruction::createCaloFromCache(G4LogicalVolume * caloLV,
+		G4ThreeVector position,G4String name,
+		const std::vector<cachedSensor>& sensors){
+
+	G4LogicalVolume* layerLV=0;
+	G4int currentlayer=-1;
+	for(size_t i=0;i<sensors.size();i++){
+		const cachedSensor& s=sensors.at(i);
+		if(s.layer!=currentlayer){
+			currentlayer=s.layer;
+			profiler_.begin("layer "+createString(currentlayer),activecells_.size());
+			G4VPhysicalVolume* layerPV=0;
+			layerLV=placeLayerVolume(caloLV,s.dimz,
+					G4ThreeVector(position.x(),position.y(),s.posz-caloorigin_.z()),
+					name+"layer"+createString(currentlayer),layerPV);
+		}
+		G4VPhysicalVolume * absorber=0;
+		auto activesensor=createSandwich(layerLV,s.dimxy,s.dimxy,s.dimz,
+				G4ThreeVector(s.posx-caloorigin_.x()-position.x(),
+						s.posy-caloorigin_.y()-position.y(),0),
+				name+"layer"+createString(s.layer)+"_sensor_"+createString(i),
+				s.absfraction,absorber,activecells_.size());
+		sensorContainer sensordesc(activesensor,
+				s.dimxy,s.dimz,s.area,
+				s.posx,s.posy,s.posz,s.layer,absorber);
+		sensordesc.setEnergyscalefactor(s.energyscale);
+		sensordesc.setGridPosition(s.grid,s.ix,s.iy);
+		activecells_.push_back(sensordesc);
+	}
+	G4cout << "created " << activecells_.size() << " sensors from "
+			<< sensorCacheFile() << G4endl;
 
 }
 
@@ -501,7 +1263,8 @@ void B4DetectorConstruction::DefineMaterials()
 			kStateGas, 2.73*kelvin, 3.e-18*pascal);
 
 	// Print materials
-	G4cout << *(G4Material::GetMaterialTable()) << G4endl;
+	if(verbose_>0)
+		G4cout << *(G4Material::GetMaterialTable()) << G4endl;
 
 
 	// Get materials
@@ -522,6 +1285,7 @@ void B4DetectorConstruction::DefineMaterials()
 
 G4VPhysicalVolume* B4DetectorConstruction::DefineVolumes()
 {
+	profiler_.begin("world",0);
 	// Geometry parameters
 	calorSizeXY  = 30.*cm;
 
@@ -530,9 +1294,18 @@ G4VPhysicalVolume* B4DetectorConstruction::DefineVolumes()
 
 
 
-    //auto calorThickness = nofEELayers * layerThicknessEE + nofHB*layerThicknessHB;
+	//the envelope holds the layers with a small margin, the world only
+	//the envelope and the default gun position of B4PrimaryGeneratorAction
+	G4double calofront=0, caloback=0;
+	calorimeterExtent(calofront,caloback);
+	G4double envelopefront=calofront-envelopemargin_;
+	G4double envelopeback=caloback+envelopemargin_;
+	caloorigin_=G4ThreeVector(0,0,(envelopefront+envelopeback)/2);
+
+	const G4double gunposition=-200*cm;
 	auto worldSizeXY = 1.2 * calorSizeXY;
-	G4double worldSizeZ  = 11 * m;
+	G4double worldSizeZ  = 2*std::max(std::fabs(gunposition),
+			std::max(std::fabs(envelopefront),std::fabs(envelopeback))) + 20*cm;
 
 
 
@@ -541,7 +1314,7 @@ G4VPhysicalVolume* B4DetectorConstruction::DefineVolumes()
 	//
 	auto worldS
 	= new G4Box("World",           // its name
-			worldSizeXY/2, worldSizeXY/2, worldSizeZ); // its size
+			worldSizeXY/2, worldSizeXY/2, worldSizeZ/2); // its size
 
 	auto worldLV
 	= new G4LogicalVolume(
@@ -560,24 +1333,110 @@ G4VPhysicalVolume* B4DetectorConstruction::DefineVolumes()
 			0,                // copy number
 			fCheckOverlaps);  // checking overlaps
 
+	//
+	// Calorimeter envelope, the layers are placed in its frame
+	//
+	auto envelopeS
+	= new G4Box("Calorimeter",
+			calorSizeXY/2+envelopemargin_, calorSizeXY/2+envelopemargin_,
+			(envelopeback-envelopefront)/2);
+
+	envelopeLV_
+	= new G4LogicalVolume(
+			envelopeS,        // its solid
+			defaultMaterial,  // its material
+			"Calorimeter");   // its name
+
+	new G4PVPlacement(
+			0,                // no rotation
+			caloorigin_,      // its position
+			envelopeLV_,      // its logical volume
+			"Calorimeter",    // its name
+			worldLV,          // its mother  volume
+			false,            // no boolean operation
+			0,                // copy number
+			fCheckOverlaps);  // checking overlaps
+
 	//
 	// Calorimeter
 	//
-	createCalo(worldLV,G4ThreeVector(0,0,0),"");
+	createCalo(envelopeLV_,G4ThreeVector(0,0,0)-caloorigin_,"");
 
 
 
 	G4cout << "created in total "<< activecells_.size()<<" sensors" <<G4endl;
 
+	profiler_.begin("sensor lookup",activecells_.size());
+	buildSensorLookup();
+	profiler_.begin("neighbour graph",activecells_.size());
+	buildNeighbourGraph();
+	buildSensorLocator();
+
+	//without sharing, each sensor has three solids, three logical volumes
+	//and two daughter placements
+	size_t nsaved=activecells_.size()-sandwichcache_.size();
+	G4cout << "sandwich volumes: "<< sandwichcache_.size() << " shapes for "
+			<< activecells_.size() <<" sensors, saved "<< 3*nsaved << " solids, "
+			<< 3*nsaved << " logical volumes and "<< 2*nsaved << " placements (~"
+			<< nsaved*(3*sizeof(G4Box)+3*sizeof(G4LogicalVolume)+2*sizeof(G4PVPlacement))/1024
+			<< " kB)" << G4endl;
+	if(replicaregions_.size())
+		G4cout << "replicated regions: "<< replicaregions_.size() << " holding "
+		<< replicatable_.size() << " sensors without individual placements" << G4endl;
+	worldPV_=worldPV;
+
+	//
+	// Regions with their own production cuts, set with
+	// /run/setCutForRegion Calorimeter|Absorber|Active <cut>
+	// They start at the Geant4 default and do not follow /run/setCut.
+	//
+	profiler_.begin("regions",activecells_.size());
+	auto createRegion=[](const G4String& name){
+		auto region=new G4Region(name);
+		auto cuts=new G4ProductionCuts;
+		cuts->SetProductionCut(0.7*mm);
+		region->SetProductionCuts(cuts);
+		return region;
+	};
+	auto caloRegion=createRegion("Calorimeter");
+	auto absorberRegion=createRegion("Absorber");
+	auto activeRegion=createRegion("Active");
+	caloRegion->AddRootLogicalVolume(envelopeLV_);
+	for(auto& c: sandwichcache_){
+		absorberRegion->AddRootLogicalVolume(c.second.absorber->GetLogicalVolume());
+		activeRegion->AddRootLogicalVolume(c.second.active->GetLogicalVolume());
+	}
+
 	//
 	// Visualization attributes
 	//
+	profiler_.begin("vis attributes",activecells_.size());
 	worldLV->SetVisAttributes (G4VisAttributes::GetInvisible());
+	envelopeLV_->SetVisAttributes (G4VisAttributes::GetInvisible());
 
 	auto simpleBoxVisAtt= new G4VisAttributes(G4Colour(1.0,.0,.0));
 	simpleBoxVisAtt->SetVisibility(true);
-	for(auto& v: activecells_){
-		v.getVol()->GetLogicalVolume()->SetVisAttributes(simpleBoxVisAtt);
+	for(auto& c: sandwichcache_){
+		c.second.active->GetLogicalVolume()->SetVisAttributes(simpleBoxVisAtt);
+	}
+
+	//the run manager voxelizes again at the first run, this pass is only for timing
+	if(profilevoxels_){
+		profiler_.begin("voxelization",activecells_.size());
+		G4GeometryManager::GetInstance()->CloseGeometry(true,false,worldPV);
+		G4GeometryManager::GetInstance()->OpenGeometry(worldPV);
+	}
+	profiler_.end(activecells_.size());
+	profiler_.print();
+
+	if(showerlibparameters_.mode==B4ShowerLibraryParameters::library_use){
+		if(showerlibrary_.open(showerlibparameters_.file)
+				&& showerlibrary_.getHeader().geometryhash!=configHash()){
+			//the showers are sensor offsets of the recording geometry
+			G4cout << "WARNING: shower library "<< showerlibparameters_.file
+					<< " was recorded with a different geometry, not used" << G4endl;
+			showerlibrary_.close();
+		}
 	}
 	//
 	// Always return the physical World
@@ -590,6 +1449,37 @@ G4VPhysicalVolume* B4DetectorConstruction::DefineVolumes()
 
 void B4DetectorConstruction::ConstructSDandField()
 { 
+	if(readoutmode_ == readout_sd){
+		auto calorSD
+		= new B4CalorimeterSD("CalorimeterSD", "CalorimeterHC", this);
+		G4SDManager::GetSDMpointer()->AddNewDetector(calorSD);
+		//gap and absorber logical volumes are shared between sensors
+		for(auto& c: sandwichcache_){
+			SetSensitiveDetector(c.second.active->GetLogicalVolume(),calorSD);
+			if(readoutabsorber_)
+				SetSensitiveDetector(c.second.absorber->GetLogicalVolume(),calorSD);
+		}
+	}
+
+	//one model per thread and region, the parameters are shared. Fast
+	//simulation is managed per region and the sandwich volumes are root
+	//volumes of their own regions, so the models are attached to all three
+	for(const auto& region: {"Calorimeter","Absorber","Active"}){
+		auto g4region=G4RegionStore::GetInstance()->GetRegion(region);
+		if(fastsimparameters_.enabled)
+			new B4EMShowerModel(G4String("EMShowerModel")+region,
+					g4region,this,&fastsimparameters_);
+		if(showerlibrary_.isOpen())
+			new B4ShowerLibraryModel(G4String("ShowerLibraryModel")+region,
+					g4region,this,&showerlibrary_,&showerlibparameters_);
+	}
+
+	if(killescaping_){
+		auto escapeSD = new B4EscapeSD("EscapeSD");
+		G4SDManager::GetSDMpointer()->AddNewDetector(escapeSD);
+		SetSensitiveDetector(worldPV_->GetLogicalVolume(),escapeSD);
+	}
+
 	// Create global magnetic field messenger.
 	// Uniform magnetic field is then created automatically if
 	// the field value is not zero.
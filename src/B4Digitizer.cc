@@ -0,0 +1,125 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+//
+/// \file B4Digitizer.cc
+/// \brief Implementation of the B4Digitizer class
+
+#include "B4Digitizer.hh"
+
+#include "G4GenericMessenger.hh"
+#include "G4SystemOfUnits.hh"
+#include "Randomize.hh"
+
+#include <cmath>
+#include <algorithm>
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+B4Digitizer::B4Digitizer()
+: enabled_(false),
+  calibrate_(true),
+  noise_(0),
+  adclsb_(0),
+  adcsaturation_(0)
+{
+	fMessenger = new G4GenericMessenger(this,"/B4/digi/","digitization");
+	fMessenger->DeclareProperty("enable",enabled_,
+			"digitize the sensor energies at the end of each event");
+	fMessenger->DeclareProperty("calibrate",calibrate_,
+			"apply the sensor energy scale factors");
+	fMessenger->DeclarePropertyWithUnit("noise","MeV",noise_,
+			"Gaussian noise per channel, 0 to disable");
+	fMessenger->DeclarePropertyWithUnit("adcLSB","MeV",adclsb_,
+			"energy per ADC count, 0 disables the quantization");
+	fMessenger->DeclareProperty("adcSaturation",adcsaturation_,
+			"maximum ADC count, 0 for no saturation");
+	fMessenger->DeclareMethod("maskDead",&B4Digitizer::maskDead,
+			"mask a dead channel by detid");
+	fMessenger->DeclareMethod("maskNoisy",&B4Digitizer::maskNoisy,
+			"mask a noisy channel by detid");
+	fMessenger->DeclareMethod("clearMask",&B4Digitizer::clearMask,
+			"unmask all channels");
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+B4Digitizer::~B4Digitizer()
+{
+	delete fMessenger;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void B4Digitizer::beginRun(const std::vector<sensorContainer>& sensors){
+	size_t n=sensors.size();
+	gain_.resize(n);
+	mask_.resize(n);
+	status_.resize(n);
+	noisebuffer_.assign(n,0);
+	for(size_t i=0;i<n;i++){
+		const auto& s=sensors.at(i);
+		status_[i]=channel_ok;
+		if(deadchannels_.count(s.getGlobalDetID()))
+			status_[i]|=channel_dead;
+		if(noisychannels_.count(s.getGlobalDetID()))
+			status_[i]|=channel_noisy;
+		mask_[i]= status_[i]==channel_ok ? 1 : 0;
+		gain_[i]= calibrate_ ? s.getEnergyscalefactor() : 1;
+	}
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void B4Digitizer::process(std::vector<G4double>& energies, G4double threshold){
+	const size_t n=std::min(energies.size(),gain_.size());
+	G4double* __restrict e=energies.data();
+	const G4double* __restrict gain=gain_.data();
+	const G4double* __restrict mask=mask_.data();
+	G4double* __restrict noise=noisebuffer_.data();
+
+	// random numbers are drawn in bulk, the loops below have no calls
+	if(noise_>0)
+		G4RandGauss::shootArray(n,noise,0,noise_);
+
+	if(adclsb_>0){
+		const G4double invlsb=1./adclsb_;
+		const G4double maxcount= adcsaturation_>0 ? adcsaturation_ : 1e300;
+		for(size_t i=0;i<n;i++){
+			G4double c=std::floor((e[i]*gain[i]+noise[i])*invlsb+0.5);
+			c=std::min(std::max(c,0.),maxcount);
+			G4double v=c*adclsb_*mask[i];
+			e[i]= v>=threshold ? v : 0;
+		}
+	}
+	else{
+		for(size_t i=0;i<n;i++){
+			G4double v=(e[i]*gain[i]+noise[i])*mask[i];
+			e[i]= v>=threshold ? v : 0;
+		}
+	}
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
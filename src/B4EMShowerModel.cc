@@ -0,0 +1,182 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+//
+/// \file B4EMShowerModel.cc
+/// \brief Implementation of the B4EMShowerModel class
+
+#include "B4EMShowerModel.hh"
+#include "B4DetectorConstruction.hh"
+#include "B4aEventAction.hh"
+
+#include "G4FastTrack.hh"
+#include "G4FastStep.hh"
+#include "G4Track.hh"
+#include "G4Material.hh"
+#include "G4Electron.hh"
+#include "G4Positron.hh"
+#include "G4Gamma.hh"
+#include "G4EventManager.hh"
+#include "G4SystemOfUnits.hh"
+#include "G4PhysicalConstants.hh"
+#include "Randomize.hh"
+
+#include <cmath>
+#include <algorithm>
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+B4EMShowerModel::B4EMShowerModel(const G4String& name, G4Region* envelope,
+                                 const B4DetectorConstruction* detector,
+                                 const B4EMShowerParameters* parameters)
+ : G4VFastSimulationModel(name, envelope),
+   fDetector(detector),
+   fParameters(parameters)
+{
+  auto material = detector->getActiveMaterial();
+  fX0 = material->GetRadlen();
+
+  // mixture rules (PDG), elemental radiation lengths in g/cm2 from the
+  // Dahl fit, critical energies from the Rossi approximation for solids
+  const auto elements = material->GetElementVector();
+  const G4double* fractions = material->GetFractionVector();
+  G4double ecoverx0 = 0;
+  fZ = 0;
+  for ( size_t i=0; i<material->GetNumberOfElements(); i++ ) {
+    G4double z = (*elements)[i]->GetZ();
+    G4double a = (*elements)[i]->GetA()/(g/mole);
+    G4double x0 = 716.4*a/(z*(z+1)*std::log(287/std::sqrt(z)))*g/cm2;
+    ecoverx0 += fractions[i]*(610*MeV/(z+1.24))/x0;
+    fZ += fractions[i]*z;
+  }
+  G4double x0density = fX0*material->GetDensity();
+  fEc = ecoverx0*x0density;
+  fRM = 21.2052*MeV/ecoverx0/material->GetDensity();
+
+  G4cout << "EM shower parameterisation in " << material->GetName()
+         << ": X0 = " << fX0/mm << " mm, RM = " << fRM/mm << " mm, Ec = "
+         << fEc/MeV << " MeV, Z = " << fZ << G4endl;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+B4EMShowerModel::~B4EMShowerModel()
+{}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool B4EMShowerModel::IsApplicable(const G4ParticleDefinition& particle)
+{
+  return &particle == G4Electron::Definition()
+      || &particle == G4Positron::Definition()
+      || &particle == G4Gamma::Definition();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool B4EMShowerModel::ModelTrigger(const G4FastTrack& fastTrack)
+{
+  auto track = fastTrack.GetPrimaryTrack();
+  if ( track->GetKineticEnergy() < fParameters->minenergy ) return false;
+
+  auto particle = track->GetDefinition();
+  if ( particle == G4Electron::Definition() ) return fParameters->electrons;
+  if ( particle == G4Positron::Definition() ) return fParameters->positrons;
+  if ( particle == G4Gamma::Definition() )    return fParameters->photons;
+  return false;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void B4EMShowerModel::DoIt(const G4FastTrack& fastTrack, G4FastStep& fastStep)
+{
+  // the energy goes to the sensors directly, not into the step,
+  // so neither the sensitive detector nor the stepping action count it
+  fastStep.KillPrimaryTrack();
+  fastStep.ProposePrimaryTrackPathLength(0.);
+
+  auto eventAction = static_cast<B4aEventAction*>(
+      G4EventManager::GetEventManager()->GetUserEventAction());
+  if ( !eventAction ) return;
+
+  auto track = fastTrack.GetPrimaryTrack();
+  G4double energy = track->GetKineticEnergy();
+  G4ThreeVector origin = track->GetPosition();
+  G4ThreeVector direction = track->GetMomentumDirection();
+  G4ThreeVector e1 = direction.orthogonal().unit();
+  G4ThreeVector e2 = direction.cross(e1);
+  G4bool isphoton = track->GetDefinition() == G4Gamma::Definition();
+
+  // longitudinal profile, tmax = (a-1)/b
+  G4double lny = std::max(std::log(energy/fEc), 1.);
+  G4double tmax = std::max(lny - 0.858 + (isphoton ? 1. : 0.), 0.5);
+  G4double a = std::max(0.21 + (0.492 + 2.38/fZ)*lny, 1.1);
+  G4double b = (a - 1)/tmax;
+  G4double depthscale = fX0*fParameters->longitudinalscale;
+
+  // lateral profile, E in GeV
+  G4double lnE = std::log(energy/GeV);
+  G4double z1 = 0.0251 + 0.00319*lnE;
+  G4double z2 = 0.1162 - 0.000381*fZ;
+  G4double k1 = 0.659 - 0.00309*fZ;
+  G4double k2 = 0.645;
+  G4double k3 = -2.59;
+  G4double k4 = 0.3585 + 0.0421*lnE;
+  G4double p1 = 2.632 - 0.00094*fZ;
+  G4double p2 = 0.401 + 0.00187*fZ;
+  G4double p3 = 1.313 - 0.0686*lnE;
+  G4double rscale = fRM*fParameters->lateralscale;
+
+  G4int nspots = std::min(std::max(G4int(energy/fParameters->spotenergy), 10),
+                          std::max(fParameters->maxspots, 10));
+  // weighted tracks from the neutron roulette, see B4aStackingAction
+  G4double spotenergy = energy*track->GetWeight()*fParameters->energyscale/nspots;
+  G4int trackid = track->GetTrackID();
+
+  for ( G4int i=0; i<nspots; i++ ) {
+    G4double t = G4RandGamma::shoot(a, b);
+    G4double tau = t/tmax;
+
+    G4double arg = (p2-tau)/p3;
+    G4double pcore = std::min(std::max(p1*std::exp(arg-std::exp(arg)), 0.), 1.);
+    G4double radius = G4UniformRand() < pcore
+        ? (z1 + z2*tau)*rscale
+        : k1*(std::exp(k3*(tau-k2)) + std::exp(k4*(tau-k2)))*rscale;
+    // inverse of the cumulative of 2rR^2/(r^2+R^2)^2
+    G4double u = std::min(G4UniformRand(), 0.9999);
+    G4double r = radius*std::sqrt(u/(1-u));
+    G4double phi = twopi*G4UniformRand();
+
+    G4ThreeVector spot = origin + t*depthscale*direction
+                       + r*(std::cos(phi)*e1 + std::sin(phi)*e2);
+    size_t idx = 0;
+    if ( fDetector->getSensorIndexAt(spot, idx) )
+      eventAction->addFastSimEnergy(idx, spotenergy, trackid);
+    else
+      eventAction->addLeakage(spotenergy);
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -0,0 +1,73 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+//
+/// \file B4EscapeSD.cc
+/// \brief Implementation of the B4EscapeSD class
+
+#include "B4EscapeSD.hh"
+#include "B4aEventAction.hh"
+
+#include "G4Step.hh"
+#include "G4Track.hh"
+#include "G4EventManager.hh"
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+B4EscapeSD::B4EscapeSD(const G4String& name)
+ : G4VSensitiveDetector(name),
+   fEventAction(nullptr)
+{}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+B4EscapeSD::~B4EscapeSD()
+{}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void B4EscapeSD::Initialize(G4HCofThisEvent*)
+{
+  // the leakage is summed in the event action of this thread
+  fEventAction = static_cast<B4aEventAction*>(
+      G4EventManager::GetEventManager()->GetUserEventAction());
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool B4EscapeSD::ProcessHits(G4Step* step,
+                                G4TouchableHistory*)
+{
+  auto preStepPoint = step->GetPreStepPoint();
+  if ( preStepPoint->GetStepStatus() != fGeomBoundary ) return false;
+
+  if ( fEventAction )
+    fEventAction->addLeakage(preStepPoint->GetKineticEnergy()*preStepPoint->GetWeight());
+  step->GetTrack()->SetTrackStatus(fStopAndKill);
+
+  return true;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
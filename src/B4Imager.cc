@@ -0,0 +1,161 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+//
+/// \file B4Imager.cc
+/// \brief Implementation of the B4Imager class
+
+#include "B4Imager.hh"
+
+#include "G4GenericMessenger.hh"
+#include "G4SystemOfUnits.hh"
+
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+#include <algorithm>
+#include <map>
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+B4Imager::B4Imager()
+: enabled_(false),
+  pixels_(32),
+  nsensors_(0),
+  nlayers_(0),
+  matrixpixels_(0)
+{
+	fMessenger = new G4GenericMessenger(this,"/B4/image/","per-layer image output");
+	fMessenger->DeclareProperty("enable",enabled_,
+			"write the sensor energies resampled to N x N pixels per layer."
+			" Only effective before the next run.");
+	fMessenger->DeclareProperty("pixels",pixels_,
+			"number of pixels N per image side");
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+B4Imager::~B4Imager()
+{
+	delete fMessenger;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+/*
+ * the fraction of a sensor's area in a pixel is the product of the
+ * overlaps of the intervals in x and y
+ */
+void B4Imager::buildMatrix(const std::vector<sensorContainer>& sensors){
+	std::map<int,size_t> layerindex;
+	G4double xmin=DBL_MAX, xmax=-DBL_MAX, ymin=DBL_MAX, ymax=-DBL_MAX;
+	for(const auto& s: sensors){
+		layerindex[s.getLayer()]=0;
+		xmin=std::min(xmin,s.getPosx()-s.getDimxy()/2);
+		xmax=std::max(xmax,s.getPosx()+s.getDimxy()/2);
+		ymin=std::min(ymin,s.getPosy()-s.getDimxy()/2);
+		ymax=std::max(ymax,s.getPosy()+s.getDimxy()/2);
+	}
+	size_t nlayers=0;
+	for(auto& l: layerindex)
+		l.second=nlayers++;
+
+	const size_t n=pixels_;
+	const G4double pitch=std::max(xmax-xmin,ymax-ymin)/n;
+
+	offsets_.assign(1,0);
+	pixel_.clear();
+	weight_.clear();
+	for(const auto& s: sensors){
+		const G4double half=s.getDimxy()/2;
+		const G4double x0=s.getPosx()-half-xmin, x1=s.getPosx()+half-xmin;
+		const G4double y0=s.getPosy()-half-ymin, y1=s.getPosy()+half-ymin;
+		const size_t ixmin=std::max(x0/pitch,0.), ixmax=std::min((size_t)std::ceil(x1/pitch),n);
+		const size_t iymin=std::max(y0/pitch,0.), iymax=std::min((size_t)std::ceil(y1/pitch),n);
+		const size_t layeroffset=layerindex[s.getLayer()]*n*n;
+		const G4double area=s.getDimxy()*s.getDimxy();
+		for(size_t iy=iymin;iy<iymax;iy++){
+			G4double dy=std::min(y1,(iy+1)*pitch)-std::max(y0,iy*pitch);
+			if(dy<=0)
+				continue;
+			for(size_t ix=ixmin;ix<ixmax;ix++){
+				G4double dx=std::min(x1,(ix+1)*pitch)-std::max(x0,ix*pitch);
+				if(dx<=0)
+					continue;
+				pixel_.push_back(layeroffset+iy*n+ix);
+				weight_.push_back(dx*dy/area);
+			}
+		}
+		offsets_.push_back(pixel_.size());
+	}
+	nsensors_=sensors.size();
+	nlayers_=nlayers;
+	matrixpixels_=pixels_;
+	G4cout << "B4Imager: "<< nlayers_ << " layers of " << n << " x " << n
+			<< " pixels of " << pitch/mm << " mm, " << pixel_.size()
+			<< " sensor-pixel overlaps" << G4endl;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void B4Imager::beginRun(const std::vector<sensorContainer>& sensors,
+		const G4String& prefix, size_t nevents){
+	if(!enabled_ || sensors.empty() || pixels_<1)
+		return;
+	if(nsensors_!=sensors.size() || matrixpixels_!=pixels_)
+		buildMatrix(sensors);
+
+	std::vector<size_t> shape;
+	shape.push_back(nlayers_);
+	shape.push_back(pixels_);
+	shape.push_back(pixels_);
+	image_.open(prefix+"_image.npy",npyWriter::type_float32,shape,nevents);
+	event_.open(prefix+"_image_event.npy",npyWriter::type_int32,1,nevents);
+}
+
+void B4Imager::endRun(){
+	image_.close();
+	event_.close();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void B4Imager::process(const std::vector<G4double>& energies, G4double threshold,
+		G4int event){
+	if(!image_.isOpen())
+		return;
+	float* image=image_.nextFloatRow();
+	std::memset(image,0,nlayers_*matrixpixels_*matrixpixels_*sizeof(float));
+	const size_t n=std::min(energies.size(),nsensors_);
+	for(size_t i=0;i<n;i++){
+		const G4double e=energies[i];
+		if(e<threshold)
+			continue;
+		for(size_t k=offsets_[i];k<offsets_[i+1];k++)
+			image[pixel_[k]]+=e*weight_[k];
+	}
+	if(event_.isOpen())
+		*event_.nextIntRow()=event;
+}
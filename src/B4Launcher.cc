@@ -0,0 +1,222 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+//
+/// \file B4Launcher.cc
+/// \brief Implementation of the B4Launcher class
+
+#include "B4Launcher.hh"
+
+#include "G4UIcommand.hh"
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+B4Launcher::B4Launcher(G4int njobs, const G4String& cpus,
+                       const G4String& outfile, G4long seed)
+ : fNJobs(njobs),
+   fCpus(cpus),
+   fOutfile(outfile),
+   fSeed(seed),
+   fShard(-1),
+   fReportFd(-1),
+   fExitCode(0)
+{}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+B4Launcher::~B4Launcher()
+{
+  if ( fReportFd >= 0 ) close(fReportFd);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4String B4Launcher::getOutputFile() const
+{
+  return fOutfile + "_j" + std::to_string(fShard);
+}
+
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+std::vector<int> B4Launcher::cpuList() const
+{
+  std::vector<int> cpus;
+  if ( fCpus.empty() ) return cpus;
+#ifdef __linux__
+  if ( fCpus == "auto" ) {
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if ( sched_getaffinity(0, sizeof(mask), &mask) == 0 ) {
+      for ( int i=0; i<CPU_SETSIZE; i++ )
+        if ( CPU_ISSET(i, &mask) ) cpus.push_back(i);
+    }
+    return cpus;
+  }
+#endif
+  std::istringstream in(fCpus);
+  std::string item;
+  while ( std::getline(in, item, ',') )
+    if ( !item.empty() ) cpus.push_back(G4UIcommand::ConvertToInt(item.c_str()));
+  return cpus;
+}
+
+void B4Launcher::pin(int cpu) const
+{
+  if ( cpu < 0 ) return;
+#ifdef __linux__
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  CPU_SET(cpu, &mask);
+  if ( sched_setaffinity(0, sizeof(mask), &mask) != 0 )
+    G4cerr << "B4Launcher: could not pin shard " << fShard << " to CPU " << cpu << G4endl;
+#else
+  G4cerr << "B4Launcher: CPU pinning is only available on Linux" << G4endl;
+#endif
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool B4Launcher::launch()
+{
+  auto cpus = cpuList();
+  auto start = std::chrono::steady_clock::now();
+  G4cout << "B4Launcher: starting " << fNJobs << " shards" << G4endl;
+
+  for ( G4int i=0; i<fNJobs; i++ ) {
+    int fds[2];
+    if ( pipe(fds) != 0 ) {
+      G4cerr << "B4Launcher: pipe failed, " << i << " shards started" << G4endl;
+      fExitCode = 1;
+      break;
+    }
+    shardStatus s;
+    s.cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+    s.events = 0;
+    s.seconds = 0;
+    s.status = -1;
+    s.pid = fork();
+    if ( s.pid == 0 ) {
+      // shard: close the read ends, output goes to its own log
+      close(fds[0]);
+      for ( const auto& other : fShards ) close(other.fd);
+      fShards.clear();
+      fShard = i;
+      fReportFd = fds[1];
+      G4String log = getOutputFile() + ".log";
+      int logfd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if ( logfd >= 0 ) {
+        dup2(logfd, STDOUT_FILENO);
+        dup2(logfd, STDERR_FILENO);
+        close(logfd);
+      }
+      pin(s.cpu);
+      return true;
+    }
+    close(fds[1]);
+    if ( s.pid < 0 ) {
+      close(fds[0]);
+      G4cerr << "B4Launcher: fork failed, " << i << " shards started" << G4endl;
+      fExitCode = 1;
+      break;
+    }
+    s.fd = fds[0];
+    fShards.push_back(s);
+  }
+
+  // the report arrives just before the shard exits, read until end of file
+  for ( auto& s : fShards ) {
+    std::string text;
+    char buffer[256];
+    ssize_t n;
+    while ( (n = read(s.fd, buffer, sizeof(buffer))) > 0 )
+      text.append(buffer, n);
+    close(s.fd);
+    std::istringstream(text) >> s.events >> s.seconds;
+    int status = 0;
+    waitpid(s.pid, &status, 0);
+    s.status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    if ( s.status != 0 ) fExitCode = 1;
+  }
+
+  std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+  summarise(wall.count());
+  return false;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void B4Launcher::report(G4int events, G4double seconds)
+{
+  if ( fReportFd < 0 ) return;
+  std::string text = std::to_string(events) + " " + std::to_string(seconds) + "\n";
+  ssize_t written = write(fReportFd, text.data(), text.size());
+  (void)written;
+  close(fReportFd);
+  fReportFd = -1;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void B4Launcher::summarise(G4double wallseconds)
+{
+  std::ostringstream out;
+  out << std::setw(6) << "shard" << std::setw(8) << "pid" << std::setw(6) << "cpu"
+      << std::setw(10) << "events"
+      << std::setw(12) << "time [s]" << std::setw(12) << "events/s"
+      << std::setw(8) << "status" << "\n";
+  G4int total = 0;
+  for ( size_t i=0; i<fShards.size(); i++ ) {
+    const auto& s = fShards[i];
+    total += s.events;
+    out << std::setw(6) << i << std::setw(8) << s.pid << std::setw(6) << s.cpu
+        << std::setw(10) << s.events
+        << std::setw(12) << std::fixed << std::setprecision(1) << s.seconds
+        << std::setw(12) << (s.seconds > 0 ? s.events/s.seconds : 0.)
+        << std::setw(8) << s.status << "\n";
+  }
+  out << "job seed " << fSeed << "\n";
+  out << "total " << total << " events in " << std::fixed << std::setprecision(1)
+      << wallseconds << " s, " << (wallseconds > 0 ? total/wallseconds : 0.)
+      << " events/s" << "\n";
+
+  G4cout << out.str() << std::flush;
+  std::ofstream file(fOutfile + "_summary.txt");
+  file << out.str();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
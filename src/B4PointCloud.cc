@@ -0,0 +1,220 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+//
+/// \file B4PointCloud.cc
+/// \brief Implementation of the B4PointCloud class
+
+#include "B4PointCloud.hh"
+
+#include "G4GenericMessenger.hh"
+#include "G4SystemOfUnits.hh"
+
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+B4PointCloud::B4PointCloud()
+: enabled_(false),
+  k_(8),
+  layermetric_(false),
+  layerdistance_(10*mm),
+  bucketsize_(0),
+  indexedsensors_(0),
+  indexedlayermetric_(false),
+  indexedlayerdistance_(0)
+{
+	nbuckets_[0]=nbuckets_[1]=nbuckets_[2]=0;
+	fMessenger = new G4GenericMessenger(this,"/B4/pointcloud/","point cloud output");
+	fMessenger->DeclareProperty("enable",enabled_,
+			"write the hits above threshold with their k nearest neighbours."
+			" Only effective before the first run.");
+	fMessenger->DeclareProperty("k",k_,
+			"number of nearest neighbours per hit. Only effective before the first run.");
+	fMessenger->DeclareMethod("metric",&B4PointCloud::setMetric,
+			"euclidean: distance in x, y, z. layer: distance in x, y and"
+			" layer number times layerDistance.")
+			.SetCandidates("euclidean layer");
+	fMessenger->DeclarePropertyWithUnit("layerDistance","mm",layerdistance_,
+			"distance of adjacent layers for the layer metric");
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+B4PointCloud::~B4PointCloud()
+{
+	delete fMessenger;
+}
+
+void B4PointCloud::setMetric(G4String metric){
+	layermetric_ = metric=="layer";
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void B4PointCloud::buildIndex(const std::vector<sensorContainer>& sensors){
+	const size_t n=sensors.size();
+	point_.resize(3*n);
+	G4double min[3]={DBL_MAX,DBL_MAX,DBL_MAX}, max[3]={-DBL_MAX,-DBL_MAX,-DBL_MAX};
+	std::vector<G4double> sizes(n);
+	for(size_t i=0;i<n;i++){
+		const auto& s=sensors[i];
+		G4double p[3]={s.getPosx(),s.getPosy(),
+				layermetric_ ? s.getLayer()*layerdistance_ : s.getPosz()};
+		for(size_t d=0;d<3;d++){
+			point_[3*i+d]=p[d];
+			min[d]=std::min(min[d],p[d]);
+			max[d]=std::max(max[d],p[d]);
+		}
+		sizes[i]=s.getDimxy();
+	}
+	std::nth_element(sizes.begin(),sizes.begin()+n/2,sizes.end());
+	bucketsize_=std::max(sizes[n/2],1e-3*mm);
+
+	for(size_t d=0;d<3;d++)
+		nbuckets_[d]=(long)((max[d]-min[d])/bucketsize_)+1;
+	bucket_.resize(3*n);
+	for(size_t i=0;i<n;i++){
+		for(size_t d=0;d<3;d++)
+			bucket_[3*i+d]=std::min((long)((point_[3*i+d]-min[d])/bucketsize_),nbuckets_[d]-1);
+	}
+	indexedsensors_=n;
+	indexedlayermetric_=layermetric_;
+	indexedlayerdistance_=layerdistance_;
+	G4cout << "B4PointCloud: " << nbuckets_[0] << " x " << nbuckets_[1] << " x "
+			<< nbuckets_[2] << " buckets of " << bucketsize_/mm << " mm" << G4endl;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void B4PointCloud::consider(size_t i, size_t j, size_t k){
+	if(i==j)
+		return;
+	const float* a=&point_[3*hits_[i]];
+	const float* b=&point_[3*hits_[j]];
+	float d2=(a[0]-b[0])*(a[0]-b[0])+(a[1]-b[1])*(a[1]-b[1])+(a[2]-b[2])*(a[2]-b[2]);
+	if(heap_.size()<k){
+		heap_.push_back(std::make_pair(d2,(G4int)j));
+		std::push_heap(heap_.begin(),heap_.end());
+	}
+	else if(d2<heap_.front().first){
+		std::pop_heap(heap_.begin(),heap_.end());
+		heap_.back()=std::make_pair(d2,(G4int)j);
+		std::push_heap(heap_.begin(),heap_.end());
+	}
+}
+
+/*
+ * A hit in a bucket in shell r around the bucket of hit i (Chebyshev
+ * distance r in buckets) is at least (r-1) bucket sizes away, so the
+ * search ends after shell r once the k-th distance is below r bucket sizes.
+ */
+void B4PointCloud::process(const std::vector<G4double>& energies, G4double threshold,
+		const std::vector<sensorContainer>& sensors){
+
+	detid_.clear();
+	energy_.clear();
+	x_.clear();
+	y_.clear();
+	z_.clear();
+	layer_.clear();
+	knn_.clear();
+	knndistance_.clear();
+
+	if(sensors.empty() || k_<1)
+		return;
+	if(indexedsensors_!=sensors.size() || indexedlayermetric_!=layermetric_
+			|| indexedlayerdistance_!=layerdistance_)
+		buildIndex(sensors);
+
+	hits_.clear();
+	const size_t nsensors=std::min(energies.size(),sensors.size());
+	for(size_t i=0;i<nsensors;i++){
+		if(energies[i]<threshold)continue;
+		const auto& s=sensors[i];
+		hits_.push_back(i);
+		detid_.push_back(s.getGlobalDetID());
+		energy_.push_back(energies[i]);
+		x_.push_back(s.getPosx());
+		y_.push_back(s.getPosy());
+		z_.push_back(s.getPosz());
+		layer_.push_back(s.getLayer());
+	}
+	const size_t nhits=hits_.size();
+	const size_t k=k_;
+	knn_.assign(nhits*k,-1);
+	knndistance_.assign(nhits*k,-1);
+
+	const bool bruteforce = nhits<=4*k+32;
+	if(!bruteforce){
+		sortedhits_.resize(nhits);
+		for(size_t i=0;i<nhits;i++){
+			const long* b=&bucket_[3*hits_[i]];
+			sortedhits_[i]=std::make_pair(bucketKey(b[0],b[1],b[2]),i);
+		}
+		std::sort(sortedhits_.begin(),sortedhits_.end());
+	}
+	const long maxshell=std::max(nbuckets_[0],std::max(nbuckets_[1],nbuckets_[2]));
+
+	for(size_t i=0;i<nhits;i++){
+		heap_.clear();
+		if(bruteforce){
+			for(size_t j=0;j<nhits;j++)
+				consider(i,j,k);
+		}
+		else{
+			const long* b=&bucket_[3*hits_[i]];
+			for(long r=0;r<=maxshell;r++){
+				for(long bx=std::max(b[0]-r,0L);bx<=std::min(b[0]+r,nbuckets_[0]-1);bx++){
+					for(long by=std::max(b[1]-r,0L);by<=std::min(b[1]+r,nbuckets_[1]-1);by++){
+						const bool inner = std::abs(bx-b[0])<r && std::abs(by-b[1])<r;
+						//inside the x-y square of the shell only the two z faces
+						const long step = inner ? 2*r : 1;
+						for(long bz=b[2]-r;bz<=b[2]+r;bz+=step){
+							if(bz<0 || bz>=nbuckets_[2])
+								continue;
+							auto it=std::lower_bound(sortedhits_.begin(),sortedhits_.end(),
+									std::make_pair(bucketKey(bx,by,bz),(size_t)0));
+							for(;it!=sortedhits_.end() && it->first==bucketKey(bx,by,bz);++it)
+								consider(i,it->second,k);
+						}
+					}
+				}
+				if(heap_.size()==k || heap_.size()==nhits-1){
+					G4double reach=r*bucketsize_;
+					if(heap_.size()==nhits-1 || heap_.front().first<=reach*reach)
+						break;
+				}
+			}
+		}
+		std::sort_heap(heap_.begin(),heap_.end());
+		for(size_t n=0;n<heap_.size();n++){
+			knn_[i*k+n]=heap_[n].second;
+			knndistance_[i*k+n]=std::sqrt(heap_[n].first);
+		}
+	}
+}
@@ -31,7 +31,13 @@
 #include "B4PrimaryGeneratorAction.hh"
 
 #include "G4RunManager.hh"
+#include "G4Run.hh"
+#include "G4EventManager.hh"
+#include "G4TrackingManager.hh"
+#include "G4UIcommand.hh"
 #include "G4LogicalVolumeStore.hh"
+#include "G4PhysicalVolumeStore.hh"
+#include "G4GenericMessenger.hh"
 #include "G4LogicalVolume.hh"
 #include "G4Box.hh"
 #include "G4Event.hh"
@@ -48,11 +54,10 @@
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
- B4PrimaryGeneratorAction * B4PrimaryGeneratorAction::globalgen=0;
-
 B4PrimaryGeneratorAction::B4PrimaryGeneratorAction()
  : G4VUserPrimaryGeneratorAction(),
-   fParticleGun(nullptr)
+   fParticleGun(nullptr),
+   particleid_(gamma)
 {
   G4int nofParticles = 1;
   fParticleGun = new G4ParticleGun(nofParticles);
@@ -67,13 +72,62 @@ B4PrimaryGeneratorAction::B4PrimaryGeneratorAction()
   fParticleGun->SetParticleEnergy(100.*GeV);
 
 
+  // the INCL generator is thread local and draws from the thread's engine
   G4INCL::Random::setGenerator( new G4INCL::Geant4RandomGenerator());
 
-  globalgen=this;
-
   xorig_=0;
   yorig_=0;
 
+  startatenvelope_=false;
+  runseed_=0;
+  eventoffset_=0;
+  shard_=0;
+  replayrun_=-1;
+  replayevent_=-1;
+  replayverbose_=1;
+  fMessenger = new G4GenericMessenger(this,"/B4/gun/","gun control");
+  fMessenger->DeclareProperty("startAtEnvelope",startatenvelope_,
+      "start the primaries at the front face of the calorimeter envelope");
+  fMessenger->DeclareProperty("seed",runseed_,
+      "seed of the job, the engine is reseeded per event from it, the run and the event number");
+  fMessenger->DeclareProperty("eventOffset",eventoffset_,
+      "added to the event ID, to split a run over jobs without changing the events");
+  fMessenger->DeclareProperty("shard",shard_,
+      "index of this process in a job, adds shard times the events of the run to the offset");
+  fMessenger->DeclareMethod("replay",&B4PrimaryGeneratorAction::setReplay,
+      "[run:]event, simulate only this event number, -1 to switch off");
+  fMessenger->DeclareProperty("replayVerbose",replayverbose_,
+      "tracking verbosity of the replayed event");
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void B4PrimaryGeneratorAction::setReplay(G4String spec)
+{
+  replayrun_=-1;
+  auto colon=spec.find(':');
+  if(colon!=std::string::npos){
+    replayrun_=G4UIcommand::ConvertToInt(spec.substr(0,colon).c_str());
+    spec=spec.substr(colon+1);
+  }
+  replayevent_=G4UIcommand::ConvertToInt(spec.c_str());
+}
+
+G4int B4PrimaryGeneratorAction::getEventNumber(const G4Event* event)const
+{
+  G4int offset=eventoffset_;
+  auto run = G4RunManager::GetRunManager()->GetCurrentRun();
+  if(shard_>0 && run)
+    offset+=shard_*run->GetNumberOfEventToBeProcessed();
+  return offset+event->GetEventID();
+}
+
+G4bool B4PrimaryGeneratorAction::isReplayEvent(const G4Event* event)const
+{
+  if(replayevent_<0 || getEventNumber(event)!=replayevent_)
+    return false;
+  auto run = G4RunManager::GetRunManager()->GetCurrentRun();
+  return replayrun_<0 || (run && run->GetRunID()==replayrun_);
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -81,6 +135,7 @@ B4PrimaryGeneratorAction::B4PrimaryGeneratorAction()
 B4PrimaryGeneratorAction::~B4PrimaryGeneratorAction()
 {
   delete fParticleGun;
+  delete fMessenger;
 }
 std::vector<G4String> B4PrimaryGeneratorAction::generateAvailableParticles(){
 	std::vector<G4String> out;
@@ -136,9 +191,53 @@ G4String B4PrimaryGeneratorAction::setParticleID(enum particles p){
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
+/*
+ * splitmix64 finaliser, a bijection with full avalanche
+ */
+static unsigned long long mix64(unsigned long long z)
+{
+  z += 0x9e3779b97f4a7c15ULL;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+/*
+ * The job seed, run ID and event number are mixed one after the other,
+ * so no two different tuples share a seed by cancellation (adding them
+ * would map (s, n+1) and (s+1, n) to the same value). RanecuEngine takes
+ * two seeds below 2^31, zero is not allowed.
+ */
+void B4PrimaryGeneratorAction::seedEvent(const G4Event* event)
+{
+  G4int runid = 0;
+  auto run = G4RunManager::GetRunManager()->GetCurrentRun();
+  if ( run ) runid = run->GetRunID();
+
+  unsigned long long x = mix64((unsigned long long)runseed_);
+  x = mix64(x ^ (unsigned long long)runid);
+  x = mix64(x ^ (unsigned long long)getEventNumber(event));
+  long seeds[3];
+  for ( int i=0; i<2; i++ ) {
+    x = mix64(x);
+    seeds[i] = (long)(x & 0x7ffffffeULL) + 1;
+  }
+  seeds[2] = 0;
+  G4Random::setTheSeeds(seeds);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
 void B4PrimaryGeneratorAction::GeneratePrimaries(G4Event* anEvent)
 {
   // This function is called at the begining of event
+  if(isReplaying()){
+    if(!isReplayEvent(anEvent))
+      return;
+    G4cout << "replaying event " << getEventNumber(anEvent) << G4endl;
+    G4EventManager::GetEventManager()->GetTrackingManager()->SetVerboseLevel(replayverbose_);
+  }
+  seedEvent(anEvent);
 
   // In order to avoid dependence of PrimaryGeneratorAction
   // on DetectorConstruction class we get world volume 
@@ -174,11 +273,31 @@ void B4PrimaryGeneratorAction::GeneratePrimaries(G4Event* anEvent)
   G4double sign=1;
 
   G4double zposition = -200*cm;
+  if(startatenvelope_){
+    auto envelopePV
+      = G4PhysicalVolumeStore::GetInstance()->GetVolume("Calorimeter",false);
+    G4Box* envelopeBox = nullptr;
+    if ( envelopePV ) {
+      envelopeBox = dynamic_cast<G4Box*>(envelopePV->GetLogicalVolume()->GetSolid());
+    }
+    if ( envelopeBox ) {
+      // just inside, a point on the surface would be ambiguous
+      zposition = envelopePV->GetTranslation().z()
+                - envelopeBox->GetZHalfLength() + 1*um;
+    }
+    else {
+      G4Exception("B4PrimaryGeneratorAction::GeneratePrimaries()",
+        "MyCode0003", JustWarning, "Calorimeter envelope not found, gun stays at -200 cm.");
+    }
+  }
   double energy_max=100;
+  // the type alternates with the shot number, not with the events this
+  // instance generated before, so it does not depend on the thread or shard
+  long long firstshot=(long long)getEventNumber(anEvent)*nshots;
 
   for(int i=0;i<nshots;i++){
 
-	  if(particleid_==gamma)
+	  if((firstshot+i)%2==0)
 		  particleid_=pionneutral;
 	  else
 		  particleid_=gamma;
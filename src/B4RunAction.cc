@@ -30,21 +30,59 @@
 
 #include "B4RunAction.hh"
 #include "B4Analysis.hh"
+#include "B4aStackingAction.hh"
 
 #include "G4Run.hh"
 #include "G4RunManager.hh"
 #include "G4UnitsTable.hh"
 #include "G4SystemOfUnits.hh"
+#include "G4Threading.hh"
+#include "G4AccumulableManager.hh"
+#include "G4GenericMessenger.hh"
+#include "G4RegionStore.hh"
+#include "G4Region.hh"
+#include "G4ProductionCuts.hh"
+
+#include "G4AutoLock.hh"
+
+#include <cmath>
+#include <algorithm>
+#include <fstream>
+#include <cstdio>
+#include <unistd.h>
 #include "B4PrimaryGeneratorAction.hh"
 
 #include "B4aEventAction.hh"
+namespace {
+  G4Mutex shardMutex = G4MUTEX_INITIALIZER;
+}
+
+std::vector<B4RunAction::shard> B4RunAction::shards_;
+
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
 B4RunAction::B4RunAction(B4PrimaryGeneratorAction *gen, B4aEventAction* ev, G4String fname)
- : G4UserRunAction()
+ : G4UserRunAction(),
+   sharded_(false),
+   eventsinjob_(0),
+   benchmark_(false),
+   edepsum_(0.),
+   edepsum2_(0.),
+   refedep_(-1)
 { 
 	fname_=fname;
 	eventact_=ev;
+	if(ev)
+		ev->runaction_=this;
+
+  G4AccumulableManager::Instance()->RegisterAccumulable(edepsum_);
+  G4AccumulableManager::Instance()->RegisterAccumulable(edepsum2_);
+
+  fMessenger = new G4GenericMessenger(this,"/B4/bench/","benchmark of the run time against the cuts");
+  fMessenger->DeclareProperty("enable",benchmark_,
+      "print events/s and the change of the mean deposited energy at the end of each run");
+  fMessenger->DeclareMethod("resetReference",&B4RunAction::resetReference,
+      "take the next run as reference for the deposited energy");
   // set printing event number per each event
   G4RunManager::GetRunManager()->SetPrintProgress(1);     
 
@@ -61,46 +99,254 @@ B4RunAction::B4RunAction(B4PrimaryGeneratorAction *gen, B4aEventAction* ev, G4St
   analysisManager->SetNtupleMerging(true);
     // Note: merging ntuples is available only with Root output
 
+  generator_=gen;
+  booked_=false;
+
+  G4cout << "run action initialised" << G4endl;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+B4RunAction::~B4RunAction()
+{
+  delete fMessenger;
+  delete G4AnalysisManager::Instance();  
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void B4RunAction::setShardedOutput(G4bool sharded)
+{
+  sharded_=sharded;
+  G4AnalysisManager::Instance()->SetNtupleMerging(!sharded);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4String B4RunAction::baseFileName()const
+{
+  G4String name=fname_;
+  if(name.size()>5 && name.substr(name.size()-5)==".root")
+    name=name.substr(0,name.size()-5);
+  return name;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+/*
+ * the master waits for all workers to end their run before its own
+ * EndOfRunAction, so the shard list is complete here
+ */
+void B4RunAction::writeManifest(const G4Run* run)
+{
+  G4String file=baseFileName()+"_manifest.txt";
+  G4String tmpfile=file+".tmp"+std::to_string(getpid());
+  std::ofstream out(tmpfile);
+  G4AutoLock lock(&shardMutex);
+  std::sort(shards_.begin(),shards_.end(),[](const shard& a, const shard& b){
+    return a.file<b.file;});
+  out << "# run " << run->GetRunID() << ", " << run->GetNumberOfEvent()
+      << " events in " << shards_.size() << " shards\n";
+  for(const auto& s: shards_)
+    out << s.file << " " << s.events << "\n";
+  shards_.clear();
+  out.close();
+  if(!out || std::rename(tmpfile.c_str(),file.c_str())){
+    std::remove(tmpfile.c_str());
+    G4cout << "could not write manifest "<< file << G4endl;
+    return;
+  }
+  G4cout << "wrote manifest "<< file << G4endl;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void B4RunAction::bookNtuple()
+{
   // Book histograms, ntuple
   //
-  
+  auto ev=eventact_;
+  // async output writes the events to its own file, only the sensors
+  // ntuple is booked
+  ev->eventntuple_=-1;
+  if(!ev->async_)
+	  bookEventNtuple();
+  bookSensorNtuple();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void B4RunAction::bookEventNtuple()
+{
+  auto analysisManager = G4AnalysisManager::Instance();
 
   // Creating ntuple
   //
-  analysisManager->CreateNtuple("B4", "Edep and TrackL");
-  generator_=gen;
+  auto ev=eventact_;
+  ev->eventntuple_=analysisManager->CreateNtuple("B4", "Edep and TrackL");
+  auto compact=ev->isCompact();
+  // only book what is enabled, column ids of -1 are not filled
+  auto bookI=[ev,analysisManager](const G4String& name)->G4int{
+	  if(!ev->isColumnEnabled(name)) return -1;
+	  return analysisManager->CreateNtupleIColumn(name);
+  };
+  auto bookD=[ev,analysisManager](const G4String& name)->G4int{
+	  if(!ev->isColumnEnabled(name)) return -1;
+	  return analysisManager->CreateNtupleDColumn(name);
+  };
+  auto bookVector=[ev,analysisManager,compact](const G4String& name,
+		  std::vector<double>& d, std::vector<float>& f){
+	  if(!ev->isColumnEnabled(name)) return;
+	  if(compact)
+		  analysisManager->CreateNtupleFColumn(name,f);
+	  else
+		  analysisManager->CreateNtupleDColumn(name,d);
+  };
+
   G4cout << "creating particle entries" << G4endl;
-  auto parts=generator_->generateAvailableParticles();
-  for(const auto& p:parts){
-	  analysisManager->CreateNtupleIColumn(p);
+  ev->ntuple_isparticle_.clear();
+  if(compact){
+	  ev->ntuple_true_particle_=bookI("true_particle");
+  }
+  else{
+	  auto parts=generator_->generateAvailableParticles();
+	  for(const auto& p:parts){
+		  ev->ntuple_isparticle_.push_back(bookI(p));
+	  }
+  }
+  ev->ntuple_event_=bookI("event");
+  ev->ntuple_true_energy_=bookD("true_energy");
+  ev->ntuple_true_x_=bookD("true_x");
+  ev->ntuple_true_y_=bookD("true_y");
+  ev->ntuple_true_r_=bookD("true_r");
+  ev->ntuple_leakage_=-1;
+  if(ev->detector_ && ev->detector_->isKillingEscapes())
+	  ev->ntuple_leakage_=bookD("leakage");
+  ev->ntuple_dropped_tracks_=-1;
+  ev->ntuple_dropped_energy_=-1;
+  if(ev->stacking_ && ev->stacking_->isActive()){
+	  ev->ntuple_dropped_tracks_=bookI("dropped_tracks");
+	  ev->ntuple_dropped_energy_=bookD("dropped_energy");
   }
-  analysisManager->CreateNtupleDColumn("true_energy");
-  analysisManager->CreateNtupleDColumn("true_x");
-  analysisManager->CreateNtupleDColumn("true_y");
-  analysisManager->CreateNtupleDColumn("true_r");
-
-//if(false){
-  analysisManager->CreateNtupleDColumn("rechit_energy",eventact_->rechit_energy_);
- // analysisManager->CreateNtupleDColumn("rechit_absorber_energy",eventact_->rechit_absorber_energy_);
-  analysisManager->CreateNtupleDColumn("rechit_x",eventact_->rechit_x_);
-  analysisManager->CreateNtupleDColumn("rechit_y",eventact_->rechit_y_);
-  analysisManager->CreateNtupleDColumn("rechit_z",eventact_->rechit_z_);
-  analysisManager->CreateNtupleDColumn("rechit_layer",eventact_->rechit_layer_);
-  analysisManager->CreateNtupleDColumn("rechit_varea",eventact_->rechit_varea_);
-  analysisManager->CreateNtupleDColumn("rechit_vz",eventact_->rechit_vz_);
-  analysisManager->CreateNtupleDColumn("rechit_vxy",eventact_->rechit_vxy_);
-  analysisManager->CreateNtupleIColumn("rechit_detid",eventact_->rechit_detid_);
-//}
-  analysisManager->FinishNtuple();
 
-  G4cout << "run action initialised" << G4endl;
+  if(ev->getOutputMode()==B4aEventAction::output_sparse){
+	  ev->ntuple_nhits_=bookI("nhits");
+	  if(ev->isColumnEnabled("hit_detid"))
+		  analysisManager->CreateNtupleIColumn("hit_detid",ev->hit_detid_);
+	  bookVector("hit_energy",ev->hit_energy_,ev->hit_energy_f_);
+  }
+  else{
+	  bookVector("rechit_energy",ev->rechit_energy_,ev->rechit_energy_f_);
+	 // analysisManager->CreateNtupleDColumn("rechit_absorber_energy",eventact_->rechit_absorber_energy_);
+	  if(!ev->writeStaticGeometryOnly()){
+		  bookVector("rechit_x",ev->rechit_x_,ev->rechit_x_f_);
+		  bookVector("rechit_y",ev->rechit_y_,ev->rechit_y_f_);
+		  bookVector("rechit_z",ev->rechit_z_,ev->rechit_z_f_);
+		  bookVector("rechit_layer",ev->rechit_layer_,ev->rechit_layer_f_);
+		  bookVector("rechit_varea",ev->rechit_varea_,ev->rechit_varea_f_);
+		  bookVector("rechit_vz",ev->rechit_vz_,ev->rechit_vz_f_);
+		  bookVector("rechit_vxy",ev->rechit_vxy_,ev->rechit_vxy_f_);
+		  if(ev->isColumnEnabled("rechit_detid"))
+			  analysisManager->CreateNtupleIColumn("rechit_detid",ev->rechit_detid_);
+	  }
+  }
+  if(ev->primarytruth_){
+	  if(ev->isColumnEnabled("truth_detid"))
+		  analysisManager->CreateNtupleIColumn("truth_detid",ev->truth_detid_);
+	  if(ev->isColumnEnabled("truth_primary"))
+		  analysisManager->CreateNtupleIColumn("truth_primary",ev->truth_primary_);
+	  if(ev->isColumnEnabled("truth_fraction"))
+		  analysisManager->CreateNtupleFColumn("truth_fraction",ev->truth_fraction_);
+  }
+  if(ev->clusterer_.isEnabled()){
+	  auto& cl=ev->clusterer_;
+	  if(ev->isColumnEnabled("cluster_energy"))
+		  analysisManager->CreateNtupleDColumn("cluster_energy",cl.energy_);
+	  if(ev->isColumnEnabled("cluster_x"))
+		  analysisManager->CreateNtupleDColumn("cluster_x",cl.x_);
+	  if(ev->isColumnEnabled("cluster_y"))
+		  analysisManager->CreateNtupleDColumn("cluster_y",cl.y_);
+	  if(ev->isColumnEnabled("cluster_z"))
+		  analysisManager->CreateNtupleDColumn("cluster_z",cl.z_);
+	  if(ev->isColumnEnabled("cluster_width"))
+		  analysisManager->CreateNtupleDColumn("cluster_width",cl.width_);
+	  if(ev->isColumnEnabled("cluster_ncells"))
+		  analysisManager->CreateNtupleIColumn("cluster_ncells",cl.ncells_);
+  }
+  if(ev->pointcloud_.isEnabled()){
+	  auto& pc=ev->pointcloud_;
+	  if(ev->isColumnEnabled("pc_detid"))
+		  analysisManager->CreateNtupleIColumn("pc_detid",pc.detid_);
+	  if(ev->isColumnEnabled("pc_energy"))
+		  analysisManager->CreateNtupleFColumn("pc_energy",pc.energy_);
+	  if(ev->isColumnEnabled("pc_x"))
+		  analysisManager->CreateNtupleFColumn("pc_x",pc.x_);
+	  if(ev->isColumnEnabled("pc_y"))
+		  analysisManager->CreateNtupleFColumn("pc_y",pc.y_);
+	  if(ev->isColumnEnabled("pc_z"))
+		  analysisManager->CreateNtupleFColumn("pc_z",pc.z_);
+	  if(ev->isColumnEnabled("pc_layer"))
+		  analysisManager->CreateNtupleIColumn("pc_layer",pc.layer_);
+	  if(ev->isColumnEnabled("pc_knn"))
+		  analysisManager->CreateNtupleIColumn("pc_knn",pc.knn_);
+	  if(ev->isColumnEnabled("pc_knn_distance"))
+		  analysisManager->CreateNtupleFColumn("pc_knn_distance",pc.knndistance_);
+  }
+  analysisManager->FinishNtuple(ev->eventntuple_);
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
-B4RunAction::~B4RunAction()
+void B4RunAction::bookSensorNtuple()
 {
-  delete G4AnalysisManager::Instance();  
+  auto analysisManager = G4AnalysisManager::Instance();
+
+  // static sensor geometry, filled once per run
+  sensorntuple_=analysisManager->CreateNtuple("sensors", "sensor geometry");
+  analysisManager->CreateNtupleIColumn(sensorntuple_,"detid");
+  analysisManager->CreateNtupleDColumn(sensorntuple_,"x");
+  analysisManager->CreateNtupleDColumn(sensorntuple_,"y");
+  analysisManager->CreateNtupleDColumn(sensorntuple_,"z");
+  analysisManager->CreateNtupleIColumn(sensorntuple_,"layer");
+  analysisManager->CreateNtupleDColumn(sensorntuple_,"varea");
+  analysisManager->CreateNtupleDColumn(sensorntuple_,"vz");
+  analysisManager->CreateNtupleDColumn(sensorntuple_,"vxy");
+  analysisManager->CreateNtupleIColumn(sensorntuple_,"neighbours",sensorneighbours_);
+  analysisManager->FinishNtuple(sensorntuple_);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void B4RunAction::fillSensorNtuple()
+{
+  // the geometry is shared by all threads, write it once: with ntuple
+  // merging the master's rows are not merged with those of the workers.
+  // Sharded output has no master file, every shard gets its own copy.
+  if(!eventact_ || !eventact_->detector_)
+    return;
+  if(sharded_ ? !processesEvents() : !IsMaster())
+    return;
+
+  auto analysisManager = G4AnalysisManager::Instance();
+  const auto detector=eventact_->detector_;
+  const auto& sensors=*detector->getActiveSensors();
+  for(size_t i=0;i<sensors.size();i++){
+    const auto& s=sensors[i];
+    size_t nneighbours=0;
+    const size_t* neighbours=detector->getNeighbours(i,nneighbours);
+    sensorneighbours_.clear();
+    for(size_t k=0;k<nneighbours;k++)
+      sensorneighbours_.push_back(sensors[neighbours[k]].getGlobalDetID());
+    analysisManager->FillNtupleIColumn(sensorntuple_,0,s.getGlobalDetID());
+    analysisManager->FillNtupleDColumn(sensorntuple_,1,s.getPosx());
+    analysisManager->FillNtupleDColumn(sensorntuple_,2,s.getPosy());
+    analysisManager->FillNtupleDColumn(sensorntuple_,3,s.getPosz());
+    analysisManager->FillNtupleIColumn(sensorntuple_,4,s.getLayer());
+    analysisManager->FillNtupleDColumn(sensorntuple_,5,s.getArea());
+    analysisManager->FillNtupleDColumn(sensorntuple_,6,s.getDimz());
+    analysisManager->FillNtupleDColumn(sensorntuple_,7,s.getDimxy());
+    analysisManager->AddNtupleRow(sensorntuple_);
+  }
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -113,15 +359,34 @@ void B4RunAction::BeginOfRunAction(const G4Run* /*run*/)
   // Get analysis manager
   auto analysisManager = G4AnalysisManager::Instance();
 
+  G4AccumulableManager::Instance()->Reset();
+  runtimer_.Start();
+
+  // with sharded output the master has nothing to write
+  if(sharded_ && !processesEvents())
+    return;
+
+  // Book the ntuple on the first run, so the output mode can be
+  // chosen in the macro
+  if(!booked_){
+    bookNtuple();
+    booked_=true;
+  }
+
   // Open an output file
   //
   G4String fileName = fname_;
   analysisManager->OpenFile(fileName);
+
+  fillSensorNtuple();
+
+  if(eventact_ && processesEvents())
+    eventact_->beginRun();
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
-void B4RunAction::EndOfRunAction(const G4Run* /*run*/)
+void B4RunAction::EndOfRunAction(const G4Run* run)
 {
   // print histogram statistics
   //
@@ -132,8 +397,63 @@ void B4RunAction::EndOfRunAction(const G4Run* /*run*/)
 
   // save histograms & ntuple
   //
-  analysisManager->Write();
-  analysisManager->CloseFile();
+  if(!sharded_ || processesEvents()){
+    analysisManager->Write();
+    analysisManager->CloseFile();
+  }
+  if(sharded_){
+    if(processesEvents()){
+      G4AutoLock lock(&shardMutex);
+      shard s;
+      s.file=baseFileName()+"_t"+std::to_string(G4Threading::G4GetThreadId())+".root";
+      s.events=run->GetNumberOfEvent();
+      shards_.push_back(s);
+    }
+    else{
+      writeManifest(run);
+    }
+  }
+
+  if(eventact_ && processesEvents())
+    eventact_->endRun();
+  else if(eventact_)
+    eventact_->endMasterRun();
+
+  runtimer_.Stop();
+  if(IsMaster())
+    eventsinjob_+=run->GetNumberOfEvent();
+  G4AccumulableManager::Instance()->Merge();
+  if(benchmark_ && IsMaster())
+    printBenchmark(run);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void B4RunAction::printBenchmark(const G4Run* run)
+{
+  G4int nevents=run->GetNumberOfEvent();
+  if(nevents<1)
+    return;
+  G4double seconds=runtimer_.GetRealElapsed();
+  G4double mean=edepsum_.GetValue()/nevents;
+  G4double rms=std::sqrt(std::max(0.,edepsum2_.GetValue()/nevents-mean*mean));
+  if(refedep_<0)
+    refedep_=mean;
+
+  G4cout << "benchmark run "<< run->GetRunID() << ": "<< nevents << " events in "
+         << seconds << " s, " << (seconds>0 ? nevents/seconds : 0.) << " events/s\n"
+         << "  total Edep per event: " << G4BestUnit(mean,"Energy")
+         << " +- " << G4BestUnit(rms/std::sqrt((G4double)nevents),"Energy")
+         << ", change to reference: "
+         << (refedep_>0 ? 100.*(mean-refedep_)/refedep_ : 0.) << " %\n"
+         << "  cuts:";
+  for(const auto& name: {"Calorimeter","Absorber","Active"}){
+    auto region=G4RegionStore::GetInstance()->GetRegion(name,false);
+    if(region && region->GetProductionCuts())
+      G4cout << " " << name << " "
+             << G4BestUnit(region->GetProductionCuts()->GetProductionCut("e-"),"Length");
+  }
+  G4cout << G4endl;
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
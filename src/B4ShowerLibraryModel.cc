@@ -0,0 +1,128 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+//
+/// \file B4ShowerLibraryModel.cc
+/// \brief Implementation of the B4ShowerLibraryModel class
+
+#include "B4ShowerLibraryModel.hh"
+#include "B4DetectorConstruction.hh"
+#include "B4aEventAction.hh"
+#include "showerLibrary.h"
+
+#include "G4FastTrack.hh"
+#include "G4FastStep.hh"
+#include "G4Track.hh"
+#include "G4Electron.hh"
+#include "G4Positron.hh"
+#include "G4Gamma.hh"
+#include "G4EventManager.hh"
+#include "Randomize.hh"
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+B4ShowerLibraryModel::B4ShowerLibraryModel(const G4String& name, G4Region* envelope,
+                                           const B4DetectorConstruction* detector,
+                                           const showerLibrary* library,
+                                           const B4ShowerLibraryParameters* parameters)
+ : G4VFastSimulationModel(name, envelope),
+   fDetector(detector),
+   fLibrary(library),
+   fParameters(parameters)
+{}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+B4ShowerLibraryModel::~B4ShowerLibraryModel()
+{}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool B4ShowerLibraryModel::IsApplicable(const G4ParticleDefinition& particle)
+{
+  return &particle == G4Electron::Definition()
+      || &particle == G4Positron::Definition()
+      || &particle == G4Gamma::Definition();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool B4ShowerLibraryModel::ModelTrigger(const G4FastTrack& fastTrack)
+{
+  auto track = fastTrack.GetPrimaryTrack();
+  G4double energy = track->GetKineticEnergy();
+  if ( energy >= fParameters->maxenergy ) return false;
+
+  const auto& binning = fLibrary->getHeader();
+  G4int particle = showerLibrary::particleType(track);
+  G4int ebin = binning.energyBin(energy);
+  G4int dbin = binning.depthBin(track->GetPosition().z());
+  if ( particle < 0 || ebin < 0 || dbin < 0 ) return false;
+
+  // empty bins are simulated in full
+  return fLibrary->nShowers(particle, ebin, dbin) > 0;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void B4ShowerLibraryModel::DoIt(const G4FastTrack& fastTrack, G4FastStep& fastStep)
+{
+  // as B4EMShowerModel, the energy goes to the sensors and not into the step
+  fastStep.KillPrimaryTrack();
+  fastStep.ProposePrimaryTrackPathLength(0.);
+
+  auto eventAction = static_cast<B4aEventAction*>(
+      G4EventManager::GetEventManager()->GetUserEventAction());
+  if ( !eventAction ) return;
+
+  auto track = fastTrack.GetPrimaryTrack();
+  G4double energy = track->GetKineticEnergy();
+  G4ThreeVector origin = track->GetPosition();
+  G4ThreeVector direction = track->GetMomentumDirection();
+  G4ThreeVector e1, e2;
+  showerLibrary::frame(direction, e1, e2);
+
+  const auto& binning = fLibrary->getHeader();
+  const auto& shower = fLibrary->sample(showerLibrary::particleType(track),
+                                        binning.energyBin(energy),
+                                        binning.depthBin(origin.z()),
+                                        G4UniformRand());
+  const auto deposits = fLibrary->deposits(shower);
+  G4int trackid = track->GetTrackID();
+  G4double weight = track->GetWeight();
+
+  for ( uint32_t i=0; i<shower.n; i++ ) {
+    const auto& d = deposits[i];
+    G4ThreeVector position = origin + d.dx*e1 + d.dy*e2 + d.dz*direction;
+    G4double e = d.fraction*energy*weight;
+    size_t idx = 0;
+    if ( fDetector->getSensorIndexAt(position, idx) )
+      eventAction->addFastSimEnergy(idx, e, trackid);
+    else
+      eventAction->addLeakage(e);
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
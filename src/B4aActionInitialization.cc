@@ -33,6 +33,8 @@
 #include "B4RunAction.hh"
 #include "B4aEventAction.hh"
 #include "B4aSteppingAction.hh"
+#include "B4aTrackingAction.hh"
+#include "B4aStackingAction.hh"
 #include "B4DetectorConstruction.hh"
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -40,7 +42,8 @@
 B4aActionInitialization::B4aActionInitialization
                             (B4DetectorConstruction* detConstruction)
  : G4VUserActionInitialization(),
-   fDetConstruction(detConstruction)
+   fDetConstruction(detConstruction),
+   sharded_(false)
 {}
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -52,24 +55,37 @@ B4aActionInitialization::~B4aActionInitialization()
 
 void B4aActionInitialization::BuildForMaster() const
 {
-	auto gen=new B4PrimaryGeneratorAction;
+  // the master books the merged ntuple, its event action and stacking
+  // action only carry the configuration that decides which columns exist
+  auto gen=new B4PrimaryGeneratorAction;
   auto ev=new B4aEventAction;
-  SetUserAction(new B4RunAction(gen,ev,""));
+  ev->setGenerator(gen);
+  ev->setDetector(fDetConstruction);
+  ev->setStackingAction(new B4aStackingAction(ev));
+  auto runact=new B4RunAction(gen,ev,fname_);
+  runact->setShardedOutput(sharded_);
+  SetUserAction(runact);
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
 void B4aActionInitialization::Build() const
 {
-	auto gen=new B4PrimaryGeneratorAction;
-  SetUserAction(new B4PrimaryGeneratorAction);
+  auto gen=new B4PrimaryGeneratorAction;
+  SetUserAction(gen);
   auto eventAction = new B4aEventAction;
   eventAction->setGenerator(gen);
   eventAction->setDetector(fDetConstruction);
   auto runact=new B4RunAction(gen,eventAction,fname_);
+  runact->setShardedOutput(sharded_);
   SetUserAction(runact);
   SetUserAction(eventAction);
-  SetUserAction(new B4aSteppingAction(fDetConstruction,eventAction));
+  SetUserAction(new B4aTrackingAction(eventAction));
+  auto stackingAction = new B4aStackingAction(eventAction);
+  eventAction->setStackingAction(stackingAction);
+  SetUserAction(stackingAction);
+  if(fDetConstruction->getReadoutMode() == B4DetectorConstruction::readout_stepping)
+    SetUserAction(new B4aSteppingAction(fDetConstruction,eventAction));
   G4cout << "actions initialised" <<G4endl;
 }  
 
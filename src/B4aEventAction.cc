@@ -32,83 +32,171 @@
 #include "B4RunAction.hh"
 #include "B4Analysis.hh"
 
+#include "B4CalorHit.hh"
+
 #include "G4RunManager.hh"
+#include "G4Run.hh"
 #include "G4Event.hh"
+#include "G4SDManager.hh"
+#include "G4HCofThisEvent.hh"
 #include "G4UnitsTable.hh"
+#include "G4GenericMessenger.hh"
+#include "G4SystemOfUnits.hh"
+#include "G4Threading.hh"
+
+#include "G4AutoLock.hh"
 
 #include "Randomize.hh"
 #include <iomanip>
 
+namespace {
+  G4Mutex libraryMutex = G4MUTEX_INITIALIZER;
+}
+
+showerLibraryBuilder B4aEventAction::mergedlibrary_;
+
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
 B4aEventAction::B4aEventAction()
  : G4UserEventAction(),
    fEnergyAbs(0.),
    fEnergyGap(0.),
+   leakage_(0.),
    fTrackLAbs(0.),
    fTrackLGap(0.),
-   generator_(0)
+   ntuple_true_particle_(-1),
+   ntuple_true_energy_(-1),
+   ntuple_true_x_(-1),
+   ntuple_true_y_(-1),
+   ntuple_true_r_(-1),
+   ntuple_nhits_(-1),
+   ntuple_leakage_(-1),
+   ntuple_event_(-1),
+   ntuple_dropped_tracks_(-1),
+   ntuple_dropped_energy_(-1),
+   eventntuple_(-1),
+   fHCID(-1),
+   outputmode_(output_dense),
+   threshold_(0.01*MeV),
+   staticgeometry_(false),
+   compact_(false),
+   primarytruth_(false),
+   maxprimaries_(4),
+   recordlibrary_(false),
+   async_(false),
+   asyncqueuesize_(64),
+   npy_(false),
+   generator_(0),
+   detector_(0),
+   runaction_(0),
+   stacking_(0)
 {
 	//create vector ntuple here
 //	auto analysisManager = G4AnalysisManager::Instance();
 
-
+	fMessenger = new G4GenericMessenger(this,"/B4/output/","output control");
+	fMessenger->DeclareMethod("mode",&B4aEventAction::setOutputMode,
+			"dense: all sensors per event, sparse: only (detid,energy) above threshold."
+			" Only effective before the first run.")
+			.SetCandidates("dense sparse");
+	fMessenger->DeclarePropertyWithUnit("threshold","MeV",threshold_,
+			"energy threshold per sensor");
+	fMessenger->DeclareProperty("staticGeometry",staticgeometry_,
+			"dense mode: write only rechit_energy per event, the sensor geometry"
+			" is in the sensors ntuple. Only effective before the first run.");
+	fMessenger->DeclareProperty("compact",compact_,
+			"single true_particle column and float rechit quantities."
+			" Only effective before the first run.");
+	fMessenger->DeclareMethod("dropColumn",&B4aEventAction::dropColumn,
+			"do not book the event ntuple column with this name."
+			" Only effective before the first run.");
+	fMessenger->DeclareProperty("primaryTruth",primarytruth_,
+			"write the per-primary energy fractions of each sensor."
+			" Only effective before the first run.");
+	fMessenger->DeclareProperty("maxPrimaries",maxprimaries_,
+			"number of primaries resolved in the truth, later ones share the last index");
+	fMessenger->DeclareProperty("async",async_,
+			"write the events from a separate thread to a binary file instead of the ntuple."
+			" Only effective before the first run.");
+	fMessenger->DeclareProperty("asyncQueueSize",asyncqueuesize_,
+			"events in flight between the simulation and the writer thread");
+	fMessenger->DeclareProperty("npy",npy_,
+			"write the events as memory mapped float32 .npy arrays instead of the ntuple");
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
 B4aEventAction::~B4aEventAction()
-{}
+{
+	delete fMessenger;
+}
+
+void B4aEventAction::setOutputMode(G4String mode){
+	if(mode=="sparse")
+		outputmode_=output_sparse;
+	else
+		outputmode_=output_dense;
+}
 
 
-void B4aEventAction::accumulateVolumeInfo(G4VPhysicalVolume * volume,const G4Step* step){
+void B4aEventAction::prepareSensorVectors(){
 
 	const auto& activesensors=detector_->getActiveSensors();
 
-	bool issensor=true;
-
-	size_t idx=activesensors->size();
+	if(rechit_energy_.size()==activesensors->size())
+		return;
+
+	rechit_absorber_energy_.resize(activesensors->size(),0);
+	rechit_energy_.resize(activesensors->size(),0);
+	rechit_x_.resize(activesensors->size(),0);
+	rechit_y_.resize(activesensors->size(),0);
+	rechit_z_.resize(activesensors->size(),0);
+	rechit_layer_.resize(activesensors->size(),0);
+	rechit_varea_.resize(activesensors->size(),0);
+	rechit_vz_.resize(activesensors->size(),0);
+	rechit_vxy_.resize(activesensors->size(),0);
+	rechit_detid_.resize(activesensors->size(),0);
 	for(size_t i=0;i<activesensors->size();i++){
-		if(volume == activesensors->at(i).getVol()){
-			idx=i;
-			break;
-		}
-		if(volume == activesensors->at(i).getAbsorberVol()){
-			idx=i;
-			issensor=false;
-			break;
-		}
+		rechit_x_.at     (i)=activesensors->at(i).getPosx();
+		rechit_y_.at     (i)=activesensors->at(i).getPosy();
+		rechit_z_.at     (i)=activesensors->at(i).getPosz();
+		rechit_layer_.at (i)=activesensors->at(i).getLayer();
+		rechit_varea_.at (i)=activesensors->at(i).getArea();
+		rechit_vz_.at    (i)=activesensors->at(i).getDimz();
+		rechit_vxy_.at   (i)=activesensors->at(i).getDimxy();
+		rechit_detid_.at (i)=activesensors->at(i).getGlobalDetID();
+	}
+	if(compact_){
+		rechit_energy_f_.assign(activesensors->size(),0);
+		rechit_x_f_.assign    (rechit_x_.begin(),    rechit_x_.end());
+		rechit_y_f_.assign    (rechit_y_.begin(),    rechit_y_.end());
+		rechit_z_f_.assign    (rechit_z_.begin(),    rechit_z_.end());
+		rechit_layer_f_.assign(rechit_layer_.begin(),rechit_layer_.end());
+		rechit_varea_f_.assign(rechit_varea_.begin(),rechit_varea_.end());
+		rechit_vz_f_.assign   (rechit_vz_.begin(),   rechit_vz_.end());
+		rechit_vxy_f_.assign  (rechit_vxy_.begin(),  rechit_vxy_.end());
 	}
+}
 
-	if(idx>=activesensors->size())return;//not active volume
-
-	if(rechit_absorber_energy_.size()<=idx){
-
-		rechit_absorber_energy_.resize(activesensors->size(),0);
-		rechit_energy_.resize(activesensors->size(),0);
-		rechit_x_.resize(activesensors->size(),0);
-		rechit_y_.resize(activesensors->size(),0);
-		rechit_z_.resize(activesensors->size(),0);
-		rechit_layer_.resize(activesensors->size(),0);
-		rechit_varea_.resize(activesensors->size(),0);
-		rechit_vz_.resize(activesensors->size(),0);
-		rechit_vxy_.resize(activesensors->size(),0);
-		rechit_detid_.resize(activesensors->size(),0);
-		for(size_t i=0;i<activesensors->size();i++){
-			rechit_x_.at     (i)=activesensors->at(i).getPosx();
-			rechit_y_.at     (i)=activesensors->at(i).getPosy();
-			rechit_z_.at     (i)=activesensors->at(i).getPosz();
-			rechit_layer_.at (i)=activesensors->at(i).getLayer();
-			rechit_varea_.at (i)=activesensors->at(i).getArea();
-			rechit_vz_.at    (i)=activesensors->at(i).getDimz();
-			rechit_vxy_.at   (i)=activesensors->at(i).getDimxy();
-			rechit_detid_.at (i)=activesensors->at(i).getGlobalDetID();
-		}
+void B4aEventAction::accumulateVolumeInfo(const G4VTouchable * touchable,const G4Step* step){
 
-	}
+	bool isabsorber=false;
+	size_t idx=0;
+	if(!detector_->getSensorIndex(touchable,idx,isabsorber))
+		return;//not active volume
 
-	auto energy=step->GetTotalEnergyDeposit();
+	prepareSensorVectors();
+
+	auto energy=step->GetTotalEnergyDeposit()*step->GetTrack()->GetWeight();
+	if(energy<=0)
+		return;//transport steps, nothing to accumulate
 	rechit_energy_.at(idx)+=energy;
+	if(isabsorber)
+		rechit_absorber_energy_.at(idx)+=energy;
+	if(primarytruth_)
+		truth_.add(idx,step->GetTrack()->GetTrackID(),energy);
+	if(recordlibrary_)
+		library_.add(idx,step->GetTrack()->GetTrackID(),energy);
 
 	/*
 	size_t hitidx=allvolumes_.size();
@@ -151,6 +239,111 @@ void B4aEventAction::accumulateVolumeInfo(G4VPhysicalVolume * volume,const G4Ste
 */
 }
 
+void B4aEventAction::addFastSimEnergy(size_t idx, G4double e, G4int trackid){
+	prepareSensorVectors();
+	rechit_energy_[idx]+=e;
+	if(primarytruth_)
+		truth_.add(idx,trackid,e);
+	if(recordlibrary_)
+		library_.add(idx,trackid,e);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void B4aEventAction::beginRun()
+{
+  if(!detector_)
+	  return;
+  prepareSensorVectors();
+  if(digitizer_.isEnabled())
+	  digitizer_.beginRun(*detector_->getActiveSensors());
+  rundroppedtracks_=0;
+  rundroppedenergy_=0;
+  runevents_=0;
+
+  if(async_ && runaction_){
+	  // the event records only hold the energies and the gun truth
+	  G4String unsupported;
+	  if(primarytruth_)
+		  unsupported+=" /B4/output/primaryTruth";
+	  if(clusterer_.isEnabled())
+		  unsupported+=" /B4/cluster/enable";
+	  if(pointcloud_.isEnabled())
+		  unsupported+=" /B4/pointcloud/enable";
+	  if(unsupported.size()){
+		  G4ExceptionDescription msg;
+		  msg << "/B4/output/async does not write the output of"
+				  << unsupported << ", disable them or the async output";
+		  G4Exception("B4aEventAction::beginRun()","B4async001",FatalException,msg);
+	  }
+	  if(eventntuple_>=0){
+		  G4ExceptionDescription msg;
+		  msg << "the B4 ntuple was booked in an earlier run,"
+				  << " /B4/output/async is only effective before the first run";
+		  G4Exception("B4aEventAction::beginRun()","B4async002",FatalException,msg);
+	  }
+  }
+  if(!async_ && runaction_ && eventntuple_<0){
+	  G4ExceptionDescription msg;
+	  msg << "the B4 ntuple was not booked because the first run used async"
+			  << " output, /B4/output/async is only effective before the first run";
+	  G4Exception("B4aEventAction::beginRun()","B4async002",FatalException,msg);
+  }
+  if(async_ && runaction_)
+	  writer_.open(runFilePrefix()+".events",rechit_energy_.size(),std::max(asyncqueuesize_,1));
+  if(npy_ && runaction_)
+	  openNpy();
+  if(imager_.isEnabled() && runaction_){
+	  auto run=G4RunManager::GetRunManager()->GetCurrentRun();
+	  imager_.beginRun(*detector_->getActiveSensors(),runFilePrefix(),
+			  run ? std::max(run->GetNumberOfEventToBeProcessed(),1) : 1);
+  }
+
+  const auto& libparameters=detector_->getShowerLibraryParameters();
+  recordlibrary_ = libparameters.mode==B4ShowerLibraryParameters::library_record;
+  if(recordlibrary_){
+	  showerLibrary::header binning;
+	  detector_->getShowerLibraryBinning(binning);
+	  library_.setup(binning,std::max(libparameters.maxperbin,0));
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void B4aEventAction::endRun()
+{
+  writer_.close();
+  npyenergy_.close();
+  npytruth_.close();
+  npyevent_.close();
+  imager_.endRun();
+  if(ntuple_dropped_tracks_>=0 && runevents_>0){
+	  G4cout << "stacking cuts dropped " << rundroppedtracks_ << " tracks with "
+			  << G4BestUnit(rundroppedenergy_,"Energy") << " in " << runevents_
+			  << " events, " << G4BestUnit(rundroppedenergy_/runevents_,"Energy")
+			  << " per event" << G4endl;
+  }
+  if(!recordlibrary_)
+	  return;
+  if(G4Threading::IsWorkerThread()){
+	  G4AutoLock lock(&libraryMutex);
+	  mergedlibrary_.merge(library_);
+	  return;
+  }
+  library_.write(detector_->getShowerLibraryParameters().file);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void B4aEventAction::endMasterRun()
+{
+  if(!detector_ || detector_->getShowerLibraryParameters().mode
+		  !=B4ShowerLibraryParameters::library_record)
+	  return;
+  G4AutoLock lock(&libraryMutex);
+  mergedlibrary_.write(detector_->getShowerLibraryParameters().file);
+}
+
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
 void B4aEventAction::BeginOfEventAction(const G4Event* /*event*/)
@@ -160,8 +353,19 @@ void B4aEventAction::BeginOfEventAction(const G4Event* /*event*/)
   fEnergyGap = 0.;
   fTrackLAbs = 0.;
   fTrackLGap = 0.;
+  leakage_ = 0.;
+  droppedtracks_ = 0;
+  droppedenergy_ = 0.;
   clear();
 
+  if(primarytruth_){
+	  prepareSensorVectors();
+	  truth_.setup(rechit_energy_.size(),maxprimaries_);
+	  truth_.newEvent();
+  }
+  if(recordlibrary_)
+	  library_.newEvent();
+
   //set generator stuff
 //random particle
   //random energy
@@ -177,11 +381,197 @@ void B4aEventAction::BeginOfEventAction(const G4Event* /*event*/)
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
+void B4aEventAction::accumulateHits(const G4Event* event){
+
+	if(detector_->getReadoutMode() != B4DetectorConstruction::readout_sd)
+		return;
+
+	if(fHCID<0)
+		fHCID = G4SDManager::GetSDMpointer()->GetCollectionID("CalorimeterHC");
+
+	auto hc = static_cast<B4CalorHitsCollection*>(
+			event->GetHCofThisEvent()->GetHC(fHCID));
+	if(!hc)
+		return;
+
+	//same sums as the stepping readout: absorber deposits count to the sensor
+	for(size_t i=0;i<hc->entries();i++){
+		const auto hit=(*hc)[i];
+		rechit_energy_[hit->GetSensorIndex()] += hit->GetEdep()+hit->GetAbsorberEdep();
+		rechit_absorber_energy_[hit->GetSensorIndex()] += hit->GetAbsorberEdep();
+	}
+}
+
+void B4aEventAction::fillSparseHits(){
+	hit_detid_.clear();
+	hit_energy_.clear();
+	const auto& activesensors=detector_->getActiveSensors();
+	for(size_t i=0;i<rechit_energy_.size();i++){
+		if(rechit_energy_[i]<threshold_)continue;
+		hit_detid_.push_back(activesensors->at(i).getGlobalDetID());
+		if(compact_)
+			hit_energy_f_.push_back(rechit_energy_[i]);
+		else
+			hit_energy_.push_back(rechit_energy_[i]);
+	}
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+/*
+ * the hit buffers are swapped with the record, the writer thread returns
+ * the previous ones through the free queue
+ */
+void B4aEventAction::submitAsync(const G4Event* event){
+	auto record=writer_.acquire();
+	hit_detid_.clear();
+	hit_energy_f_.clear();
+	const auto& activesensors=detector_->getActiveSensors();
+	//dense mode keeps every sensor, below threshold as zero
+	const bool dense = outputmode_==output_dense;
+	for(size_t i=0;i<rechit_energy_.size();i++){
+		auto e=rechit_energy_[i];
+		if(e<threshold_){
+			if(!dense)continue;
+			e=0;
+		}
+		hit_detid_.push_back(activesensors->at(i).getGlobalDetID());
+		hit_energy_f_.push_back(e);
+	}
+	std::swap(record->detid,hit_detid_);
+	std::swap(record->energy,hit_energy_f_);
+	record->event=generator_->getEventNumber(event);
+	record->particle=generator_->getParticle();
+	record->trueenergy=generator_->getEnergy();
+	record->truex=generator_->getX();
+	record->truey=generator_->getY();
+	record->leakage=leakage_;
+	record->droppedtracks=droppedtracks_;
+	record->droppedenergy=droppedenergy_;
+	writer_.submit(record);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+/*
+ * the sensor order and geometry are written completely here, the event
+ * arrays are preallocated for all events of the run
+ */
+G4String B4aEventAction::runFilePrefix()const{
+	G4String file=runaction_->baseFileName();
+	if(G4Threading::IsWorkerThread())
+		file+="_t"+std::to_string(G4Threading::G4GetThreadId());
+	auto run=G4RunManager::GetRunManager()->GetCurrentRun();
+	return file+"_run"+std::to_string(run ? run->GetRunID() : 0);
+}
+
+void B4aEventAction::openNpy(){
+	G4String file=runFilePrefix()+"_";
+	auto run=G4RunManager::GetRunManager()->GetCurrentRun();
+	size_t nevents=run ? std::max(run->GetNumberOfEventToBeProcessed(),1) : 1;
+	size_t nsensors=rechit_energy_.size();
+
+	npyWriter sensors, geometry;
+	if(sensors.open(file+"sensors.npy",npyWriter::type_int32,1,nsensors)
+			&& geometry.open(file+"geometry.npy",npyWriter::type_float32,6,nsensors)){
+		for(size_t i=0;i<nsensors;i++){
+			*sensors.nextIntRow()=rechit_detid_[i];
+			float* row=geometry.nextFloatRow();
+			row[0]=rechit_x_[i];
+			row[1]=rechit_y_[i];
+			row[2]=rechit_z_[i];
+			row[3]=rechit_layer_[i];
+			row[4]=rechit_vz_[i];
+			row[5]=rechit_vxy_[i];
+		}
+	}
+
+	npyenergy_.open(file+"energy.npy",npyWriter::type_float32,nsensors,nevents);
+	npytruth_.open(file+"truth.npy",npyWriter::type_float32,6,nevents);
+	npyevent_.open(file+"event.npy",npyWriter::type_int32,1,nevents);
+}
+
+void B4aEventAction::writeNpy(const G4Event* event){
+	float* energy=npyenergy_.nextFloatRow();
+	for(size_t i=0;i<rechit_energy_.size();i++){
+		auto e=rechit_energy_[i];
+		energy[i] = e<threshold_ ? 0 : e; //threshold
+	}
+	if(npytruth_.isOpen()){
+		float* truth=npytruth_.nextFloatRow();
+		truth[0]=generator_->getParticle();
+		truth[1]=generator_->getEnergy();
+		truth[2]=generator_->getX();
+		truth[3]=generator_->getY();
+		truth[4]=generator_->getR();
+		truth[5]=leakage_;
+	}
+	if(npyevent_.isOpen())
+		*npyevent_.nextIntRow()=generator_->getEventNumber(event);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void B4aEventAction::fillPrimaryTruth(){
+	truth_.fillFractions(rechit_energy_,threshold_,
+			truth_detid_,truth_primary_,truth_fraction_);
+	const auto& activesensors=detector_->getActiveSensors();
+	for(auto& d: truth_detid_)
+		d=activesensors->at(d).getGlobalDetID();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
 void B4aEventAction::EndOfEventAction(const G4Event* event)
 {
+  // replay: only the selected event is written, the run ends after it
+  if(generator_->isReplaying()){
+	  if(!generator_->isReplayEvent(event)){
+		  clear();
+		  return;
+	  }
+	  G4RunManager::GetRunManager()->AbortRun(true);
+  }
+
   // Accumulate statistics
   //
+  prepareSensorVectors();
+  accumulateHits(event);
+  if(recordlibrary_)
+	  library_.endEvent(*detector_->getActiveSensors());
+
+  if(runaction_ && runaction_->isBenchmarking()){
+	  G4double total=0;
+	  for(const auto& e: rechit_energy_)
+		  total+=e;
+	  runaction_->addEventEnergy(total);
+  }
+
+  if(digitizer_.isEnabled())
+	  digitizer_.process(rechit_energy_,threshold_);
 
+  if(clusterer_.isEnabled())
+	  clusterer_.process(rechit_energy_,threshold_,*detector_);
+
+  if(imager_.isEnabled())
+	  imager_.process(rechit_energy_,threshold_,generator_->getEventNumber(event));
+
+  if(writer_.isOpen()){
+	  rundroppedtracks_+=droppedtracks_;
+	  rundroppedenergy_+=droppedenergy_;
+	  runevents_++;
+	  submitAsync(event);
+	  clear();
+	  return;
+  }
+  if(npyenergy_.isOpen()){
+	  rundroppedtracks_+=droppedtracks_;
+	  rundroppedenergy_+=droppedenergy_;
+	  runevents_++;
+	  writeNpy(event);
+	  clear();
+	  return;
+  }
 
 
   // get analysis manager
@@ -189,23 +579,57 @@ void B4aEventAction::EndOfEventAction(const G4Event* event)
 
   
   // fill ntuple
-  int i=0;
-  int ispart[B4PrimaryGeneratorAction::particles_size];
-  for( ;i<B4PrimaryGeneratorAction::particles_size;i++){
-	  ispart[i]=B4PrimaryGeneratorAction::globalgen->isParticle(i);
-	  analysisManager->FillNtupleIColumn(i,ispart[i]);
+  auto gen=generator_;
+  if(ntuple_event_>=0)
+	  analysisManager->FillNtupleIColumn(ntuple_event_,generator_->getEventNumber(event));
+  for(size_t i=0;i<ntuple_isparticle_.size();i++){
+	  if(ntuple_isparticle_[i]>=0)
+		  analysisManager->FillNtupleIColumn(ntuple_isparticle_[i],gen->isParticle(i));
   }
-  analysisManager->FillNtupleDColumn(i,B4PrimaryGeneratorAction::globalgen->getEnergy());
-  analysisManager->FillNtupleDColumn(i+1,B4PrimaryGeneratorAction::globalgen->getX());
-  analysisManager->FillNtupleDColumn(i+2,B4PrimaryGeneratorAction::globalgen->getY());
-  analysisManager->FillNtupleDColumn(i+3,B4PrimaryGeneratorAction::globalgen->getR());
+  if(ntuple_true_particle_>=0)
+	  analysisManager->FillNtupleIColumn(ntuple_true_particle_,gen->getParticle());
+  if(ntuple_true_energy_>=0)
+	  analysisManager->FillNtupleDColumn(ntuple_true_energy_,gen->getEnergy());
+  if(ntuple_true_x_>=0)
+	  analysisManager->FillNtupleDColumn(ntuple_true_x_,gen->getX());
+  if(ntuple_true_y_>=0)
+	  analysisManager->FillNtupleDColumn(ntuple_true_y_,gen->getY());
+  if(ntuple_true_r_>=0)
+	  analysisManager->FillNtupleDColumn(ntuple_true_r_,gen->getR());
+  if(ntuple_leakage_>=0)
+	  analysisManager->FillNtupleDColumn(ntuple_leakage_,leakage_);
+  if(ntuple_dropped_tracks_>=0)
+	  analysisManager->FillNtupleIColumn(ntuple_dropped_tracks_,droppedtracks_);
+  if(ntuple_dropped_energy_>=0)
+	  analysisManager->FillNtupleDColumn(ntuple_dropped_energy_,droppedenergy_);
+  rundroppedtracks_+=droppedtracks_;
+  rundroppedenergy_+=droppedenergy_;
+  runevents_++;
+
+  if(primarytruth_)
+	  fillPrimaryTruth();
+  if(pointcloud_.isEnabled())
+	  pointcloud_.process(rechit_energy_,threshold_,*detector_->getActiveSensors());
 
   //filling deposits and volume info for all volumes automatically..
-  for(auto& e:rechit_energy_){
-	  if(e<0.01)e=0; //threshold
+  if(outputmode_==output_sparse){
+	  fillSparseHits();
+	  if(ntuple_nhits_>=0)
+		  analysisManager->FillNtupleIColumn(ntuple_nhits_,hit_detid_.size());
+  }
+  else if(compact_){
+	  for(size_t i=0;i<rechit_energy_.size();i++){
+		  auto e=rechit_energy_[i];
+		  rechit_energy_f_[i] = e<threshold_ ? 0 : e; //threshold
+	  }
+  }
+  else{
+	  for(auto& e:rechit_energy_){
+		  if(e<threshold_)e=0; //threshold
+	  }
   }
 
-  analysisManager->AddNtupleRow();  
+  analysisManager->AddNtupleRow(eventntuple_);
 
   clear();
 }  
@@ -0,0 +1,167 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+//
+/// \file B4aStackingAction.cc
+/// \brief Implementation of the B4aStackingAction class
+
+#include "B4aStackingAction.hh"
+#include "B4aEventAction.hh"
+
+#include "G4Track.hh"
+#include "G4Neutron.hh"
+#include "G4ParticleTable.hh"
+#include "G4GenericMessenger.hh"
+#include "G4UnitsTable.hh"
+#include "G4SystemOfUnits.hh"
+#include "Randomize.hh"
+
+#include <sstream>
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+B4aStackingAction::B4aStackingAction(B4aEventAction* eventAction)
+: G4UserStackingAction(),
+  fEventAction(eventAction),
+  fMessenger(nullptr),
+  fRoulette(false),
+  fRouletteEnergy(1.*MeV),
+  fRouletteSurvival(0.1)
+{
+  fMessenger = new G4GenericMessenger(this,"/B4/stack/","secondary track cuts");
+  fMessenger->DeclareMethod("timeCut",&B4aStackingAction::setTimeCut,
+      "<particle|all> <value> <unit>: kill secondaries created later");
+  fMessenger->DeclareMethod("energyCut",&B4aStackingAction::setEnergyCut,
+      "<particle|all> <value> <unit>: kill secondaries with less kinetic energy");
+  fMessenger->DeclareProperty("neutronRoulette",fRoulette,
+      "play Russian roulette with neutrons below rouletteEnergy");
+  fMessenger->DeclarePropertyWithUnit("rouletteEnergy","MeV",fRouletteEnergy,
+      "neutrons below take part in the roulette");
+  fMessenger->DeclareProperty("rouletteSurvival",fRouletteSurvival,
+      "survival probability, survivors are weighted with its inverse");
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+B4aStackingAction::~B4aStackingAction()
+{
+  delete fMessenger;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool B4aStackingAction::parseCut(const G4String& command,
+                                   G4String& particle, G4double& value) const
+{
+  std::istringstream in(command);
+  G4String unit;
+  in >> particle >> value >> unit;
+  if ( in.fail() || !G4UnitDefinition::IsUnitDefined(unit) ) {
+    G4cout << "B4aStackingAction: expected <particle|all> <value> <unit>, got \""
+           << command << "\"" << G4endl;
+    return false;
+  }
+  if ( particle != "all"
+       && !G4ParticleTable::GetParticleTable()->FindParticle(particle) ) {
+    G4cout << "B4aStackingAction: unknown particle " << particle << G4endl;
+    return false;
+  }
+  value *= G4UnitDefinition::GetValueOf(unit);
+  return true;
+}
+
+void B4aStackingAction::setTimeCut(G4String command)
+{
+  G4String particle;
+  G4double value = 0.;
+  if ( !parseCut(command, particle, value) ) return;
+  fCuts[particle].maxtime = value;
+  fResolved.clear();
+}
+
+void B4aStackingAction::setEnergyCut(G4String command)
+{
+  G4String particle;
+  G4double value = 0.;
+  if ( !parseCut(command, particle, value) ) return;
+  fCuts[particle].minenergy = value;
+  fResolved.clear();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool B4aStackingAction::isActive() const
+{
+  return fRoulette || !fCuts.empty();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+const B4aStackingAction::speciesCuts&
+B4aStackingAction::getCuts(const G4ParticleDefinition* particle)
+{
+  // one map lookup per new track, the names are only compared once
+  auto it = fResolved.find(particle);
+  if ( it != fResolved.end() ) return it->second;
+
+  speciesCuts cuts;
+  auto all = fCuts.find("all");
+  if ( all != fCuts.end() ) cuts = all->second;
+  auto own = fCuts.find(particle->GetParticleName());
+  if ( own != fCuts.end() ) {
+    if ( own->second.maxtime < DBL_MAX ) cuts.maxtime = own->second.maxtime;
+    if ( own->second.minenergy > 0. ) cuts.minenergy = own->second.minenergy;
+  }
+  return fResolved[particle] = cuts;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4ClassificationOfNewTrack
+B4aStackingAction::ClassifyNewTrack(const G4Track* track)
+{
+  if ( track->GetParentID() == 0 || !isActive() ) return fUrgent;
+
+  auto particle = track->GetDefinition();
+  G4double energy = track->GetKineticEnergy();
+  const auto& cuts = getCuts(particle);
+  if ( track->GetGlobalTime() > cuts.maxtime || energy < cuts.minenergy ) {
+    fEventAction->addDroppedTrack(energy*track->GetWeight());
+    return fKill;
+  }
+
+  if ( fRoulette && particle == G4Neutron::Definition()
+       && energy < fRouletteEnergy && fRouletteSurvival < 1. ) {
+    if ( G4UniformRand() >= fRouletteSurvival ) {
+      fEventAction->addDroppedTrack(energy*track->GetWeight());
+      return fKill;
+    }
+    // the track is not stacked yet, changing its weight is safe
+    const_cast<G4Track*>(track)->SetWeight(track->GetWeight()/fRouletteSurvival);
+  }
+  return fUrgent;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
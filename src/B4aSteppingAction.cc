@@ -56,14 +56,14 @@ void B4aSteppingAction::UserSteppingAction(const G4Step* step)
 {
 	// Collect energy and track length step by step
 
-	// get volume of the current step
-	auto volume = step->GetPreStepPoint()->GetTouchableHandle()->GetVolume();
+	// get touchable of the current step
+	auto touchable = step->GetPreStepPoint()->GetTouchable();
 
 	//step->GetPreStepPoint()->GetTouchableHandle()->Get
 
 	// energy deposit
 
-	fEventAction->accumulateVolumeInfo(volume, step);
+	fEventAction->accumulateVolumeInfo(touchable, step);
 
 
 
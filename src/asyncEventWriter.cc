@@ -0,0 +1,127 @@
+#include "../include/asyncEventWriter.h"
+
+#include <chrono>
+#include <stdint.h>
+
+namespace{
+	typedef std::chrono::steady_clock clock_type;
+	double secondsSince(const clock_type::time_point& start){
+		return std::chrono::duration<double>(clock_type::now()-start).count();
+	}
+	const char eventFileMagic[4]={'B','4','E','V'};
+	const uint32_t eventFileVersion=2;
+}
+
+asyncEventWriter::asyncEventWriter():file_(0),full_(0),free_(0),stop_(false),
+		nsubmitted_(0),depthsum_(0),maxdepth_(0),stallseconds_(0),busyseconds_(0),bytes_(0){}
+
+asyncEventWriter::~asyncEventWriter(){
+	close();
+}
+
+bool asyncEventWriter::open(const std::string& filename, size_t nsensors, size_t queuesize){
+	close();
+	file_=std::fopen(filename.c_str(),"wb");
+	if(!file_){
+		G4cout << "asyncEventWriter: cannot open "<< filename << G4endl;
+		return false;
+	}
+	filename_=filename;
+	if(queuesize<1)
+		queuesize=1;
+	full_=new spscQueue<eventRecord*>(queuesize);
+	free_=new spscQueue<eventRecord*>(queuesize);
+	//one record per queue slot, so pushing to either queue never fails
+	pool_.clear();
+	pool_.resize(full_->capacity());
+	for(auto& r: pool_)
+		free_->push(&r);
+
+	uint32_t n=nsensors;
+	std::fwrite(eventFileMagic,1,4,file_);
+	std::fwrite(&eventFileVersion,sizeof(eventFileVersion),1,file_);
+	std::fwrite(&n,sizeof(n),1,file_);
+	bytes_=4+2*sizeof(uint32_t);
+
+	nsubmitted_=0;
+	depthsum_=0;
+	maxdepth_=0;
+	stallseconds_=0;
+	busyseconds_=0;
+	stop_=false;
+	writer_=std::thread(&asyncEventWriter::writerLoop,this);
+	return true;
+}
+
+void asyncEventWriter::close(){
+	if(!file_)
+		return;
+	stop_=true;
+	writer_.join();
+	std::fclose(file_);
+	file_=0;
+	size_t capacity=full_->capacity();
+	delete full_;
+	delete free_;
+	full_=0;
+	free_=0;
+	pool_.clear();
+
+	G4cout << "asyncEventWriter: "<< nsubmitted_ << " events, " << bytes_/1024 << " kB to "
+			<< filename_ << "\n  queue capacity " << capacity
+			<< ", mean depth " << (nsubmitted_ ? (double)depthsum_/nsubmitted_ : 0.)
+			<< ", max depth " << maxdepth_
+			<< "\n  simulation stalled " << stallseconds_ << " s, writer busy "
+			<< busyseconds_ << " s" << G4endl;
+}
+
+asyncEventWriter::eventRecord* asyncEventWriter::acquire(){
+	eventRecord* record=0;
+	if(free_->pop(record))
+		return record;
+	//back-pressure: every record is waiting for the writer
+	auto start=clock_type::now();
+	while(!free_->pop(record))
+		std::this_thread::yield();
+	stallseconds_+=secondsSince(start);
+	return record;
+}
+
+void asyncEventWriter::submit(eventRecord* record){
+	size_t depth=full_->size();
+	depthsum_+=depth;
+	if(depth>maxdepth_)
+		maxdepth_=depth;
+	nsubmitted_++;
+	full_->push(record);
+}
+
+void asyncEventWriter::writerLoop(){
+	eventRecord* record=0;
+	for(;;){
+		if(full_->pop(record)){
+			auto start=clock_type::now();
+			write(*record);
+			busyseconds_+=secondsSince(start);
+			free_->push(record);
+			continue;
+		}
+		//the producer stops submitting before setting stop_
+		if(stop_.load(std::memory_order_acquire) && !full_->size())
+			break;
+		std::this_thread::sleep_for(std::chrono::microseconds(50));
+	}
+	std::fflush(file_);
+}
+
+void asyncEventWriter::write(const eventRecord& r){
+	int32_t ids[3]={r.event,r.particle,r.droppedtracks};
+	double truth[5]={r.trueenergy,r.truex,r.truey,r.leakage,r.droppedenergy};
+	uint32_t n=r.detid.size();
+	std::fwrite(ids,sizeof(ids),1,file_);
+	std::fwrite(truth,sizeof(truth),1,file_);
+	std::fwrite(&n,sizeof(n),1,file_);
+	std::fwrite(r.detid.data(),sizeof(int32_t),n,file_);
+	std::fwrite(r.energy.data(),sizeof(float),n,file_);
+	bytes_+=sizeof(ids)+sizeof(truth)+sizeof(n)+n*(sizeof(int32_t)+sizeof(float));
+}
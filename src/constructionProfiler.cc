@@ -0,0 +1,76 @@
+#include "../include/constructionProfiler.h"
+
+#include "G4SolidStore.hh"
+#include "G4LogicalVolumeStore.hh"
+#include "G4PhysicalVolumeStore.hh"
+
+#include <iomanip>
+#include <sstream>
+
+void constructionProfiler::clear(){
+	phases_.clear();
+	running_=false;
+}
+
+constructionProfiler::counts constructionProfiler::current(size_t nsensors)const{
+	counts c;
+	c.solids=G4SolidStore::GetInstance()->size();
+	c.logical=G4LogicalVolumeStore::GetInstance()->size();
+	c.physical=G4PhysicalVolumeStore::GetInstance()->size();
+	c.sensors=nsensors;
+	return c;
+}
+
+void constructionProfiler::begin(const G4String& name, size_t nsensors){
+	if(running_)
+		end(nsensors);
+	runningname_=name;
+	start_=current(nsensors);
+	running_=true;
+	timer_.Start();
+}
+
+void constructionProfiler::end(size_t nsensors){
+	if(!running_)
+		return;
+	timer_.Stop();
+	counts now=current(nsensors);
+	phase p;
+	p.name=runningname_;
+	p.seconds=timer_.GetRealElapsed();
+	p.created.solids=now.solids-start_.solids;
+	p.created.logical=now.logical-start_.logical;
+	p.created.physical=now.physical-start_.physical;
+	p.created.sensors=now.sensors-start_.sensors;
+	phases_.push_back(p);
+	running_=false;
+}
+
+void constructionProfiler::print()const{
+	phase total;
+	total.name="total";
+	total.seconds=0;
+	//formatted locally, the flags of G4cout stay untouched
+	std::ostringstream out;
+	out << "construction profile:\n"
+			<< std::setw(16) << "phase" << std::setw(12) << "time [ms]"
+			<< std::setw(10) << "solids" << std::setw(10) << "logical"
+			<< std::setw(10) << "physical" << std::setw(10) << "sensors" << "\n";
+	out << std::fixed << std::setprecision(2);
+	auto printphase=[&out](const phase& p){
+		out << std::setw(16) << p.name << std::setw(12) << p.seconds*1000.
+				<< std::setw(10) << p.created.solids << std::setw(10) << p.created.logical
+				<< std::setw(10) << p.created.physical << std::setw(10) << p.created.sensors
+				<< "\n";
+	};
+	for(const auto& p: phases_){
+		printphase(p);
+		total.seconds+=p.seconds;
+		total.created.solids+=p.created.solids;
+		total.created.logical+=p.created.logical;
+		total.created.physical+=p.created.physical;
+		total.created.sensors+=p.created.sensors;
+	}
+	printphase(total);
+	G4cout << out.str() << G4endl;
+}
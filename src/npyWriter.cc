@@ -0,0 +1,95 @@
+#include "../include/npyWriter.h"
+
+#include "globals.hh"
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <algorithm>
+
+npyWriter::npyWriter():type_(type_float32),fd_(-1),map_(0),columns_(0),rows_(0),capacity_(0){}
+
+npyWriter::~npyWriter(){
+	close();
+}
+
+/*
+ * format version 1.0: magic, version, uint16 header length, then the
+ * header dict padded with spaces and ending in a newline
+ */
+void npyWriter::writeHeader(char* header, size_t rows)const{
+	std::memset(header,' ',headersize_);
+	std::memcpy(header,"\x93NUMPY\x01\x00",8);
+	unsigned short length=headersize_-10;
+	header[8]=length&0xff;
+	header[9]=length>>8;
+	std::string dict=std::string("{'descr': '")+(type_==type_float32 ? "<f4" : "<i4")
+			+"', 'fortran_order': False, 'shape': ("+std::to_string(rows);
+	for(const auto& d: rowshape_)
+		dict+=", "+std::to_string(d);
+	dict+="), }";
+	std::memcpy(header+10,dict.data(),std::min(dict.size(),headersize_-11));
+	header[headersize_-1]='\n';
+}
+
+bool npyWriter::map(size_t capacity){
+	size_t size=headersize_+capacity*columns_*4;
+	if(ftruncate(fd_,size)!=0)
+		return false;
+	void* map=mmap(0,size,PROT_READ|PROT_WRITE,MAP_SHARED,fd_,0);
+	if(map==MAP_FAILED)
+		return false;
+	if(map_)
+		munmap(map_,headersize_+capacity_*columns_*4);
+	map_=(char*)map;
+	capacity_=capacity;
+	return true;
+}
+
+bool npyWriter::open(const std::string& filename, dataType type, size_t columns, size_t rows){
+	return open(filename,type,std::vector<size_t>(1,columns),rows);
+}
+
+bool npyWriter::open(const std::string& filename, dataType type,
+		const std::vector<size_t>& rowshape, size_t rows){
+	close();
+	filename_=filename;
+	type_=type;
+	rowshape_=rowshape;
+	columns_=1;
+	for(const auto& d: rowshape)
+		columns_*=d;
+	rows_=0;
+	fd_=::open(filename.c_str(),O_RDWR|O_CREAT|O_TRUNC,0644);
+	if(fd_<0 || !map(rows<1 ? 1 : rows)){
+		G4cout << "npyWriter: cannot create "<< filename << G4endl;
+		if(fd_>=0)
+			::close(fd_);
+		fd_=-1;
+		return false;
+	}
+	writeHeader(map_,0);
+	return true;
+}
+
+void* npyWriter::nextRow(){
+	if(rows_==capacity_ && !map(2*capacity_)){
+		G4Exception("npyWriter::nextRow","B4npy001",FatalException,
+				("cannot grow "+filename_).c_str());
+	}
+	return map_+headersize_+(rows_++)*columns_*4;
+}
+
+void npyWriter::close(){
+	if(!map_)
+		return;
+	writeHeader(map_,rows_);
+	munmap(map_,headersize_+capacity_*columns_*4);
+	map_=0;
+	if(ftruncate(fd_,headersize_+rows_*columns_*4)!=0)
+		G4cout << "npyWriter: cannot truncate "<< filename_ << G4endl;
+	::close(fd_);
+	fd_=-1;
+	G4cout << "npyWriter: "<< rows_ << " x " << columns_ << " to " << filename_ << G4endl;
+}
@@ -0,0 +1,53 @@
+#include "../include/primaryTruthAccumulator.h"
+
+#include <algorithm>
+
+void primaryTruthAccumulator::setup(size_t nsensors, size_t maxprimaries){
+	if(maxprimaries<1)
+		maxprimaries=1;
+	if(nsensors==nsensors_ && maxprimaries==nprimaries_)
+		return;
+	nsensors_=nsensors;
+	nprimaries_=maxprimaries;
+	energy_.assign(nsensors_*nprimaries_,0);
+	sensorsum_.assign(nsensors_,0);
+	touched_.clear();
+	touched_.reserve(energy_.size());
+	if(ancestor_.size()<(1<<16))
+		ancestor_.resize(1<<16,0);
+}
+
+void primaryTruthAccumulator::newEvent(){
+	for(const auto& idx: touched_)
+		energy_[idx]=0;
+	touched_.clear();
+}
+
+void primaryTruthAccumulator::fillFractions(const std::vector<G4double>& sensorenergy,
+		G4double threshold,
+		std::vector<int>& sensor,
+		std::vector<int>& primary,
+		std::vector<float>& fraction){
+
+	sensor.clear();
+	primary.clear();
+	fraction.clear();
+
+	//sorted by primary, then sensor
+	std::sort(touched_.begin(),touched_.end());
+
+	for(const auto& idx: touched_)
+		sensorsum_[idx%nsensors_]+=energy_[idx];
+
+	for(const auto& idx: touched_){
+		size_t s=idx%nsensors_;
+		if(sensorenergy[s]<threshold || sensorsum_[s]<=0)
+			continue;
+		sensor.push_back(s);
+		primary.push_back(idx/nsensors_);
+		fraction.push_back(energy_[idx]/sensorsum_[s]);
+	}
+
+	for(const auto& idx: touched_)
+		sensorsum_[idx%nsensors_]=0;
+}
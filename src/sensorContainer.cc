@@ -1,4 +1,2 @@
 #include "../include/sensorContainer.h"
 
-
-int sensorContainer::global_detid_counter_=0;
@@ -0,0 +1,233 @@
+#include "../include/showerLibrary.h"
+
+#include "G4Track.hh"
+#include "G4Electron.hh"
+#include "G4Positron.hh"
+#include "G4Gamma.hh"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <algorithm>
+
+const char showerLibrary::magic[4]={'B','4','S','L'};
+
+int showerLibrary::header::energyBin(double e)const{
+	if(e<emin || e>=emax)
+		return -1;
+	int b=(int)(nenergybins*std::log(e/emin)/std::log(emax/emin));
+	return std::min(b,(int)nenergybins-1);
+}
+
+int showerLibrary::header::depthBin(double z)const{
+	if(z<depthmin || z>=depthmax)
+		return -1;
+	int b=(int)(ndepthbins*(z-depthmin)/(depthmax-depthmin));
+	return std::min(b,(int)ndepthbins-1);
+}
+
+showerLibrary::showerLibrary():map_(0),mapsize_(0),header_(0),bins_(0),showers_(0),deposits_(0){}
+
+showerLibrary::~showerLibrary(){
+	close();
+}
+
+bool showerLibrary::open(const std::string& filename){
+	close();
+	int fd=::open(filename.c_str(),O_RDONLY);
+	if(fd<0){
+		G4cout << "showerLibrary: cannot open "<< filename << G4endl;
+		return false;
+	}
+	struct stat st;
+	if(fstat(fd,&st) || (size_t)st.st_size<sizeof(header)){
+		::close(fd);
+		G4cout << "showerLibrary: "<< filename << " is not a shower library" << G4endl;
+		return false;
+	}
+	//the mapping stays valid after closing the descriptor
+	void* map=mmap(0,st.st_size,PROT_READ,MAP_SHARED,fd,0);
+	::close(fd);
+	if(map==MAP_FAILED){
+		G4cout << "showerLibrary: cannot map "<< filename << G4endl;
+		return false;
+	}
+	const header* h=(const header*)map;
+	size_t size=sizeof(header);
+	bool valid=std::equal(h->magic,h->magic+4,magic) && h->version==version;
+	if(valid){
+		size+=h->nBins()*sizeof(bin)+h->nshowers*sizeof(shower)+h->ndeposits*sizeof(deposit);
+		valid= size==(size_t)st.st_size;
+	}
+	if(!valid){
+		munmap(map,st.st_size);
+		G4cout << "showerLibrary: "<< filename << " is not a shower library of version "
+				<< version << G4endl;
+		return false;
+	}
+	map_=map;
+	mapsize_=st.st_size;
+	header_=h;
+	bins_=(const bin*)(header_+1);
+	showers_=(const shower*)(bins_+h->nBins());
+	deposits_=(const deposit*)(showers_+h->nshowers);
+	G4cout << "showerLibrary: mapped "<< filename << ", " << h->nshowers << " showers, "
+			<< h->ndeposits << " deposits" << G4endl;
+	return true;
+}
+
+void showerLibrary::close(){
+	if(map_)
+		munmap(map_,mapsize_);
+	map_=0;
+	mapsize_=0;
+	header_=0;
+	bins_=0;
+	showers_=0;
+	deposits_=0;
+}
+
+int showerLibrary::particleType(const G4Track* track){
+	auto p=track->GetDefinition();
+	if(p==G4Electron::Definition() || p==G4Positron::Definition())
+		return particle_electron;
+	if(p==G4Gamma::Definition())
+		return particle_photon;
+	return -1;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void showerLibraryBuilder::setup(const showerLibrary::header& binning, size_t maxperbin){
+	maxperbin_=maxperbin;
+	if(recorded_.size()==binning.nBins())
+		return;
+	binning_=binning;
+	recorded_.clear();
+	recorded_.resize(binning_.nBins());
+	nshowers_=0;
+}
+
+void showerLibraryBuilder::newEvent(){
+	std::fill(root_.begin(),root_.end(),0);
+	open_.clear();
+}
+
+void showerLibraryBuilder::registerTrack(const G4Track* track){
+	G4int trackid=track->GetTrackID();
+	G4int parentid=track->GetParentID();
+	if((size_t)trackid>=root_.size())
+		root_.resize(2*trackid+1,0);
+	root_[trackid]= (size_t)parentid<root_.size() ? root_[parentid] : 0;
+	if(root_[trackid])
+		return;
+
+	int particle=showerLibrary::particleType(track);
+	if(particle<0)
+		return;
+	int ebin=binning_.energyBin(track->GetKineticEnergy());
+	int dbin=binning_.depthBin(track->GetPosition().z());
+	if(ebin<0 || dbin<0)
+		return;
+	size_t bin=binning_.binIndex(particle,ebin,dbin);
+	if(recorded_[bin].size()>=maxperbin_)
+		return;
+
+	openShower s;
+	s.bin=bin;
+	s.energy0=track->GetKineticEnergy();
+	s.origin=track->GetPosition();
+	s.direction=track->GetMomentumDirection();
+	open_.push_back(s);
+	root_[trackid]=open_.size();
+}
+
+void showerLibraryBuilder::endEvent(const std::vector<sensorContainer>& sensors){
+	for(const auto& s: open_){
+		auto& bin=recorded_[s.bin];
+		if(bin.size()>=maxperbin_)
+			continue;
+		G4ThreeVector e1,e2;
+		showerLibrary::frame(s.direction,e1,e2);
+		recordedShower r;
+		r.energy=s.energy0;
+		for(const auto& e: s.energy){
+			if(e.second<=0)
+				continue;
+			const auto& c=sensors.at(e.first);
+			G4ThreeVector offset=G4ThreeVector(c.getPosx(),c.getPosy(),c.getPosz())-s.origin;
+			showerLibrary::deposit d;
+			d.dx=offset.dot(e1);
+			d.dy=offset.dot(e2);
+			d.dz=offset.dot(s.direction);
+			d.fraction=e.second/s.energy0;
+			r.deposits.push_back(d);
+		}
+		bin.push_back(r);
+		nshowers_++;
+	}
+	open_.clear();
+}
+
+void showerLibraryBuilder::merge(showerLibraryBuilder& other){
+	if(recorded_.size()!=other.recorded_.size())
+		setup(other.binning_,other.maxperbin_);
+	for(size_t i=0;i<recorded_.size();i++){
+		auto& from=other.recorded_[i];
+		auto& to=recorded_[i];
+		for(size_t j=0;j<from.size() && to.size()<maxperbin_;j++){
+			to.push_back(recordedShower());
+			std::swap(to.back(),from[j]);
+			nshowers_++;
+		}
+		from.clear();
+	}
+	other.nshowers_=0;
+}
+
+bool showerLibraryBuilder::write(const std::string& filename)const{
+	showerLibrary::header h=binning_;
+	std::copy(showerLibrary::magic,showerLibrary::magic+4,h.magic);
+	h.version=showerLibrary::version;
+	h.nshowers=0;
+	h.ndeposits=0;
+	std::vector<showerLibrary::bin> bins(h.nBins());
+	for(size_t i=0;i<bins.size();i++){
+		bins[i].first=h.nshowers;
+		bins[i].n=recorded_[i].size();
+		h.nshowers+=recorded_[i].size();
+		for(const auto& r: recorded_[i])
+			h.ndeposits+=r.deposits.size();
+	}
+
+	std::string tmpfile=filename+".tmp"+std::to_string(getpid());
+	std::ofstream out(tmpfile,std::ios::binary);
+	out.write((const char*)&h,sizeof(h));
+	out.write((const char*)bins.data(),bins.size()*sizeof(showerLibrary::bin));
+	uint64_t first=0;
+	for(const auto& bin: recorded_){
+		for(const auto& r: bin){
+			showerLibrary::shower s;
+			s.first=first;
+			s.n=r.deposits.size();
+			s.energy=r.energy;
+			out.write((const char*)&s,sizeof(s));
+			first+=s.n;
+		}
+	}
+	for(const auto& bin: recorded_)
+		for(const auto& r: bin)
+			out.write((const char*)r.deposits.data(),r.deposits.size()*sizeof(showerLibrary::deposit));
+	out.close();
+	if(!out || std::rename(tmpfile.c_str(),filename.c_str())){
+		std::remove(tmpfile.c_str());
+		G4cout << "showerLibraryBuilder: could not write "<< filename << G4endl;
+		return false;
+	}
+	G4cout << "showerLibraryBuilder: wrote "<< h.nshowers << " showers to "<< filename << G4endl;
+	return true;
+}